@@ -1,19 +1,586 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdbool.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <zlib.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
 
-#define MAX_ATOMS 20000
+#define INITIAL_ATOMS 4096
 #define ATOM "ATOM"
-#define ARG_ERROR_MSG "Usage: AnalyzeProtein <pdb1> <pdb2> ...\n"
+#define MODEL "MODEL"
+#define END_MODEL "ENDMDL"
+#define RECORD_LEN 4
+#define X_COLUMN 30
+#define CORD_WIDTH 8
+#define MAX_CORD_DIGITS 7
+#define READ_BLOCK 65536
+#define INFLATE_CHUNKS 4
+#define MAGIC_LEN 4
+#define GZIP_MAGIC "\x1f\x8b"
+#define GZIP_MAGIC_LEN 2
+#define ZIP_MAGIC "PK\x03\x04"
+#define ZIP_MEMBER_NAME "%s:%.*s"
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP_LOCAL_LEN 30
+#define ZIP_CENTRAL_LEN 46
+#define ZIP_END_LEN 22
+#define ZIP_MAX_COMMENT 65535
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+#define ARG_ERROR_MSG "Usage: AnalyzeProtein [options] <pdb1> <pdb2> ...\n" \
+                      "       AnalyzeProtein [options] --serve|--socket=PATH\n" \
+                      "       AnalyzeProtein [options] --bench[=N,N,...]|--generate=N\n" \
+                      "pdb files may be gzip compressed, or zip archives of pdb files.\n" \
+                      "  --dmax=hull|brute|tiled  Dmax strategy (default hull, brute verifies\n" \
+                      "                           it, tiled is brute force split over threads)\n" \
+                      "  --threads=N  number of threads (default 1). with several files, each\n" \
+                      "               thread analyzes a different file\n" \
+                      "  --kernel=auto|avx2|sse|scalar  distance kernels (default auto)\n" \
+                      "  --stream  compute Cg and Rg while parsing, keeping only the atoms\n" \
+                      "            Dmax needs\n" \
+                      "  --no-dmax  skip Dmax\n" \
+                      "  --frames  report every MODEL/ENDMDL block of a file separately\n" \
+                      "  --cache  save the atoms of each pdb file to <pdb>.apc and read them\n" \
+                      "           from there while the pdb file is unchanged (not with\n" \
+                      "           --frames or compressed files)\n" \
+                      "  --contacts=D  count atom pairs at most D apart\n" \
+                      "  --histogram=W,D  count atom pairs in bins of width W, up to D rounded\n" \
+                      "                   up to whole bins\n" \
+                      "  --rmsd=text|binary  instead of analyzing each file, print the RMSD of\n" \
+                      "                      every pair of files after optimal superposition.\n" \
+                      "                      binary is the int32 number of files, then the\n" \
+                      "                      float64 matrix in native byte order. files may be\n" \
+                      "                      gzip compressed, not zip archives\n" \
+                      "  --serve  analyze requests read from stdin until its end, answering\n" \
+                      "           each with its report followed by an empty line. requests:\n" \
+                      "             FILE <path>             a pdb file, as given in argv\n" \
+                      "             BUFFER <len> <name>     followed by <len> bytes of pdb\n" \
+                      "                                     text, reported as <name>,\n" \
+                      "                                     up to 256 MiB\n" \
+                      "  --socket=PATH  serve connections to a unix socket, one thread each,\n" \
+                      "                 up to 64 at once. PATH must not exist or be a socket\n" \
+                      "  --bench[=N,...]  time parsing, Cg, Rg and Dmax of synthetic files of N\n" \
+                      "                   atoms (default 1k to 1M) and print JSON. brute and\n" \
+                      "                   tiled Dmax are skipped above 50k atoms\n" \
+                      "  --generate=N  print a synthetic pdb file of N atoms\n"
+#define UNKNOWN_OPTION_MSG "Unknown option: %s\n"
+#define KERNEL_ERR_MSG "Kernel %s is not supported by this CPU\n"
+#define THREADS_ERR_MSG "Invalid number of threads: %s\n"
+#define DISTANCE_ERR_MSG "Invalid distance: %s\n"
+#define RMSD_ATOMS_ERR_MSG "Can not superpose %s (%d atoms) on %s (%d atoms)\n"
+#define RMSD_ARCHIVE_ERR_MSG "Can not superpose the members of an archive: %s\n"
+#define MEM_FAULT_MSG "Memory allocation failed!\n"
 #define FILE_NOT_FOUND_MSG "Error opening file: %s\n"
+#define ARCHIVE_ERR_MSG "Error reading archive: %s\n"
+#define COMPRESSION_ERR_MSG "Unsupported compression method in: %s\n"
+#define INFLATE_ERR_MSG "Error decompressing: %s\n"
 #define CONVERSION_ERR_MSG "Error in coordinate conversion  %s!\n"
+#define REQUEST_ERR_MSG "Invalid request: %s\n"
+#define SOCKET_ERR_MSG "Can not serve socket: %s\n"
+#define SIZES_ERR_MSG "Invalid number of atoms: %s\n"
 #define FILE_STATS_MSG "PDB file %s, %d atoms were read\n"
+#define MODEL_STATS_MSG "PDB file %s, model %d, %d atoms were read\n"
 #define CENTER_MASS_MSG "Cg = %.3f %.3f %.3f\n"
 #define ORB_RADIUS_MSG "Rg = %.3f\n"
 #define MAX_DISTANCE_MSG "Dmax = %.3f\n"
+#define CONTACTS_MSG "Contacts within %.3f = %ld\n"
+#define HISTOGRAM_MSG "Pairs %.3f - %.3f = %ld\n"
+#define RMSD_MSG "%.3f"
+#define RMSD_SEPARATOR ' '
+#define OPTION_PREFIX "--"
+#define DMAX_OPTION "--dmax="
+#define DMAX_HULL "hull"
+#define DMAX_BRUTE "brute"
+#define DMAX_TILED "tiled"
+#define THREADS_OPTION "--threads="
+#define TILE_ATOMS 1024
+#define REDUCE_BLOCK 4096  // atoms of a reduction block, a multiple of the vector widths.
+#define STREAM_OPTION "--stream"
+#define NO_DMAX_OPTION "--no-dmax"
+#define FRAMES_OPTION "--frames"
+#define CACHE_OPTION "--cache"
+#define CONTACTS_OPTION "--contacts="
+#define HISTOGRAM_OPTION "--histogram="
+#define HISTOGRAM_SEPARATOR ','
+#define MAX_BINS (1 << 20)
+#define CELL_GROWTH 1.25
+#define HALF_SHELL 13
+#define RMSD_OPTION "--rmsd="
+#define RMSD_TEXT "text"
+#define RMSD_BINARY "binary"
+#define QCP_ITERATIONS 50
+#define QCP_PRECISION 1e-11
+#define SERVE_OPTION "--serve"
+#define SOCKET_OPTION "--socket="
+#define FILE_REQUEST "FILE "
+#define BUFFER_REQUEST "BUFFER "
+#define END_OF_RESPONSE '\n'
+#define MAX_REQUEST_LEN (256UL << 20)  // longest BUFFER request, larger ones are refused.
+#define MAX_CONNECTIONS 64  // clients served at once, others wait to be accepted.
+#define BENCH_OPTION "--bench"
+#define GENERATE_OPTION "--generate="
+#define SIZES_SEPARATOR ","
+#define BENCH_MAX_SIZES 16
+#define BENCH_DEFAULT_SIZES {1000, 10000, 100000, 1000000}
+#define BENCH_DEFAULT_SIZES_LEN 4
+#define BENCH_BRUTE_ATOMS 50000
+#define BENCH_MIN_RUNS 3
+#define BENCH_MAX_RUNS 1000
+#define BENCH_MIN_SECONDS 0.25
+#define BENCH_SEED 12345
+#define PI 3.14159265358979323846
+#define BENCH_DENSITY 0.05  // atoms per cubic angstrom, about half of a packed protein.
+#define BENCH_LINE_LEN 81
+#define BENCH_HEADER "HEADER    SYNTHETIC BENCHMARK\n"
+#define BENCH_ATOM_LINE "ATOM  %5d  CA  ALA A%4d    %8.3f%8.3f%8.3f  1.00 20.00           C\n"
+#define BENCH_ATOM_SERIALS 100000
+#define BENCH_RESIDUES 10000
+#define BENCH_JSON_START "{\"kernel\": \"%s\", \"dmax\": \"%s\", \"threads\": %d, " \
+                         "\"results\": [\n"
+#define BENCH_JSON_RESULT "  {\"atoms\": %d, \"bytes\": %zu, " \
+                          "\"parse_seconds\": %.6g, \"parse_atoms_per_second\": %.6g, " \
+                          "\"center_mass_seconds\": %.6g, " \
+                          "\"center_mass_atoms_per_second\": %.6g, " \
+                          "\"radius_seconds\": %.6g, \"radius_atoms_per_second\": %.6g, "
+#define BENCH_JSON_DMAX "\"dmax_seconds\": %.6g, \"dmax_pairs_per_second\": %.6g}"
+// the hull compares only the pairs of its vertices, so it has no pairs per second.
+#define BENCH_JSON_HULL_DMAX "\"dmax_seconds\": %.6g, \"dmax_pairs_per_second\": null}"
+#define BENCH_JSON_NO_DMAX "\"dmax_seconds\": null, \"dmax_pairs_per_second\": null}"
+#define BENCH_JSON_END "\n]}\n"
+#define CACHE_SUFFIX ".apc"
+#define CACHE_TEMP_SUFFIX ".XXXXXX"
+#define CACHE_MAGIC "APCACHE2"
+#define CACHE_BYTE_ORDER 0x01020304u
+#define CHECKSUM_BLOCK (1u << 30)
+#define STREAM_BLOCK 4096
+#define KERNEL_OPTION "--kernel="
+#define KERNEL_AUTO "auto"
+#define KERNEL_AVX2 "avx2"
+#define KERNEL_SSE "sse"
+#define KERNEL_SCALAR "scalar"
+#define CORDS_ALIGNMENT 32
+#define HULL_EPS 1e-9
+#define HULL_FLAT 1e-4  // thinnest extent of a hull, relative to its diameter.
+#define EXTREME_DIRECTIONS 26
+
+
+/**
+ * Strategies to find the max distance between 2 atoms.
+ */
+enum DmaxMode
+{
+    hullDmax,
+    bruteDmax,
+    tiledDmax
+};
+
+/**
+ * Why the analysis of a structure failed.
+ */
+enum ProteinError
+{
+    proteinOk,
+    memoryError,
+    conversionError,  // a coordinate is not a number.
+    inflateError
+};
+
+/**
+ * Formats of a pdb file, told apart by their first bytes.
+ */
+enum FileFormat
+{
+    plainFormat,
+    gzipFormat,
+    zipFormat
+};
+
+/**
+ * Output of the all pairs RMSD mode.
+ */
+enum RmsdOutput
+{
+    noRmsd,
+    textRmsd,
+    binaryRmsd
+};
+
+/**
+ * Atom coordinates stored as separate aligned x, y and z arrays, so kernels can load
+ * consecutive atoms into vector lanes. The arrays grow geometrically and are kept between
+ * files, so a run allocates only as much as its largest file needs.
+ */
+typedef struct CordStore
+{
+    float *x;
+    float *y;
+    float *z;
+    int len;
+    int cap;
+} CordStore;
+
+/**
+ * Reduction and distance kernels over a CordStore. One instance per instruction set.
+ */
+typedef struct Kernels
+{
+    const char *name;
+    /** sums[k] = sum of all coordinates of axis k. */
+    void (*sum)(const CordStore *cords, double sums[3]);
+    /** sums[k] = sum of squared deviations of axis k from center[k]. */
+    void (*squares)(const CordStore *cords, const double center[3], double sums[3]);
+    /** max squared distance between p and the atoms in [from, to). from is a multiple of 8. */
+    float (*maxDistance)(const CordStore *cords, int from, int to, const float p[3]);
+    /** cov[3 * k + l] = sum of axis k of a times axis l of b, over atoms of the same index. */
+    void (*covariance)(const CordStore *a, const CordStore *b, double cov[9]);
+} Kernels;
+
+/**
+ * Command line options, given before the pdb files.
+ */
+typedef struct Options
+{
+    enum DmaxMode dmaxMode;
+    const Kernels *kernels;
+    int threads;
+    bool stream;
+    bool dmax;
+    bool frames;
+    bool cache;
+    mode_t cacheMode;  // permissions of new cache files, 0666 less the umask.
+    float contactCutoff;  // 0 skips contacts.
+    float binWidth;
+    int binsLen;  // 0 skips the histogram.
+    enum RmsdOutput rmsd;
+    bool serve;
+    const char *socketPath;  // NULL serves stdin.
+    int benchSizes[BENCH_MAX_SIZES];
+    int benchSizesLen;  // 0 unless benchmarking.
+    int generate;  // atoms of the synthetic file to print, 0 for none.
+} Options;
+
+/**
+ * Buffers of a thread, reused by all the files it analyzes.
+ */
+typedef struct Workspace
+{
+    CordStore cords;
+    CordStore frameCords;  // second buffer of a frame pipeline.
+} Workspace;
+
+/**
+ * Results of analyzing a structure, as returned by analyzeBuffer.
+ */
+typedef struct ProteinResult
+{
+    enum ProteinError error;
+    char badField[CORD_WIDTH + 1];  // the coordinate of a conversionError.
+    int atoms;
+    float centerMass[3];
+    float radius;
+    bool hasDmax;  // false if Dmax was skipped by the options.
+    float dMax;
+} ProteinResult;
+
+/**
+ * A synthetic file of a benchmark, and the state its timed stages pass along.
+ */
+typedef struct BenchContext
+{
+    const char *data;
+    size_t len;
+    const Options *options;
+    Workspace *workspace;
+    float centerMass[3];
+    float result;
+    bool failed;  // memory allocation failed.
+} BenchContext;
+
+/**
+ * Connections being served by the socket service, bounded by MAX_CONNECTIONS.
+ */
+typedef struct ConnectionSlots
+{
+    int active;
+    pthread_mutex_t lock;
+    pthread_cond_t left;
+} ConnectionSlots;
+
+/**
+ * A client of the socket service.
+ */
+typedef struct Connection
+{
+    int fd;
+    const Options *options;
+    ConnectionSlots *slots;  // released by the thread when the client leaves.
+} Connection;
+
+typedef struct FramePipeline FramePipeline;
+
+/**
+ * A thread decompressing a gzip file or a zip member into a ring of chunks, which the
+ * parser reads as they fill.
+ */
+typedef struct Inflater
+{
+    char chunks[INFLATE_CHUNKS][READ_BLOCK];
+    size_t lens[INFLATE_CHUNKS];
+    int head;  // chunk being read.
+    size_t offset;  // read position in the head chunk.
+    int filled;  // chunks ready to be read, starting at head.
+    bool done;  // no more chunks will be filled.
+    bool failed;  // the data is corrupt.
+    bool cancelled;  // the reader stopped reading.
+    gzFile gz;  // gzip source, NULL for a zip member.
+    const unsigned char *data;  // zip member source.
+    size_t dataLen;
+    int method;
+    z_stream zip;
+    bool ended;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} Inflater;
+
+/**
+ * Where the text of a pdb file comes from: a plain file, or an Inflater.
+ */
+typedef struct AtomSource
+{
+    FILE *file;
+    Inflater *inflater;
+} AtomSource;
+
+/**
+ * Header of a cache file. It is followed by the x, y and z arrays of the atoms, each padded
+ * like a CordStore array so the mapped file can be used as one. Files are in native byte
+ * order and belong to the pdb file of the same size and modification time, or of the same
+ * size and checksum once the file was touched or copied.
+ */
+typedef struct CacheHeader
+{
+    char magic[8];
+    uint32_t byteOrder;
+    int32_t atoms;
+    uint64_t sourceSize;
+    int64_t sourceTime;  // modification time of the pdb file, seconds.
+    int64_t sourceTimeNsec;
+    uint32_t checksum;  // crc32 of the pdb file.
+    uint32_t reserved[5];  // keeps the arrays aligned to CORDS_ALIGNMENT.
+} CacheHeader;
+
+/**
+ * Running center of mass and sums of squared deviations from it, updated one atom at a
+ * time with Welford's method.
+ */
+typedef struct AtomStats
+{
+    int count;
+    double mean[3];
+    double squares[3];
+} AtomStats;
+
+/**
+ * Destination of parsed atoms. Atoms are kept in cords, unless it is NULL. A streaming
+ * destination also sums them into stats, and a filtering one drops atoms inside the
+ * polytope of the extreme atoms seen so far, as they can not be on the hull.
+ */
+typedef struct AtomStream
+{
+    CordStore *cords;
+    bool streamStats;
+    bool filter;
+    int atoms;  // number of atoms parsed, kept or not.
+    AtomStats stats;
+    bool hasExtremes;
+    float extremes[EXTREME_DIRECTIONS][3];
+    int blockStart;  // first kept atom not filtered yet.
+    int filteredLen;  // kept atoms after the last time all of them were filtered.
+    FramePipeline *frames;  // the pipeline of the stream if parsing frames, NULL otherwise.
+    enum ProteinError error;  // why parsing failed, set on the stream given to parseAtoms.
+    char badField[CORD_WIDTH + 1];  // the coordinate of a conversionError.
+} AtomStream;
+
+/**
+ * Frames (models) of a file, parsed into 2 alternating streams. While one is parsed, the
+ * other is analyzed by a second thread.
+ */
+struct FramePipeline
+{
+    AtomStream streams[2];
+    CordStore *cords[2];
+    int models[2];  // model number of the frame in each stream.
+    bool ready[2];  // a stream holds a frame waiting for or under analysis.
+    int current;  // stream being parsed into.
+    int modelsLen;
+    bool finished;  // no more frames will be handed over.
+    bool threaded;
+    const char *fileName;
+    const Options *options;
+    FILE *out;
+    FILE *err;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/**
+ * Tiles of the i >= j pair space of a tiled Dmax, handed out to threads by index.
+ */
+typedef struct TileQueue
+{
+    const CordStore *cords;
+    const Kernels *kernels;
+    long tilesLen;
+    long next;
+    pthread_mutex_t lock;
+} TileQueue;
+
+/**
+ * A pdb file of a parallel run, and its report once analyzed.
+ */
+typedef struct FileJob
+{
+    const char *fileName;
+    char *out;
+    size_t outLen;
+    char *err;
+    size_t errLen;
+    bool failed;  // the file could not be analyzed for lack of memory.
+    bool done;
+} FileJob;
+
+/**
+ * Files of a parallel run, handed out to threads in argv order.
+ */
+typedef struct FileQueue
+{
+    FileJob *jobs;
+    int jobsLen;
+    int next;
+    Options options;  // options of a single file analysis.
+    pthread_mutex_t lock;
+    pthread_cond_t jobDone;
+} FileQueue;
+
+/**
+ * Per axis sums over fixed blocks of atoms, shared by threads that take blocks by index.
+ * Blocks do not depend on the number of threads, and are combined in order, so the result
+ * does not either.
+ */
+typedef struct Reduction
+{
+    const CordStore *cords;
+    const Kernels *kernels;
+    const double *center;  // NULL sums the coordinates, otherwise squared deviations from it.
+    double (*blocks)[3];  // sums of each block.
+    int blocksLen;
+    int next;
+    pthread_mutex_t lock;
+} Reduction;
+
+/**
+ * A thread of a tiled Dmax and the max squared distance it found.
+ */
+typedef struct TileWorker
+{
+    TileQueue *queue;
+    float maxSquared;
+} TileWorker;
+
+/**
+ * Centered structures of an all pairs RMSD run, whose pairs are handed out to threads by
+ * index.
+ */
+typedef struct RmsdQueue
+{
+    const CordStore *structures;
+    const double *norms;  // sum of squared coordinates of each structure.
+    const Kernels *kernels;
+    int structuresLen;
+    long pairsLen;
+    long next;
+    double *matrix;  // structuresLen x structuresLen, row major.
+    pthread_mutex_t lock;
+} RmsdQueue;
+
+/**
+ * Uniform grid over the atoms, with cells at least as wide as the longest distance searched,
+ * so close pairs are always in the same or adjacent cells.
+ */
+typedef struct CellList
+{
+    int dims[3];
+    float origin[3];
+    float size;  // edge of a cell.
+    int *cellStart;  // atoms of cell c are cellStart[c] .. cellStart[c + 1] - 1 of x, y, z.
+    float *x;  // atoms sorted by cell.
+    float *y;
+    float *z;
+} CellList;
+
+/**
+ * Contact count and distance histogram of the atom pairs of a structure.
+ */
+typedef struct PairCounts
+{
+    float cutoffSquared;  // negative to skip contacts.
+    float binWidth;
+    int binsLen;
+    float histogramSquared;  // squared histogram range, negative to skip it.
+    long contacts;
+    long *bins;
+} PairCounts;
+
+/**
+ * Triangle on the convex hull. Vertices are counter-clockwise when seen from outside.
+ */
+typedef struct HullFace
+{
+    int v[3];
+    int adj[3];  // adj[k] is the face across the edge v[k] -> v[k + 1].
+    double normal[3];  // unit outward normal.
+    double offset;
+    bool alive;
+} HullFace;
+
+/**
+ * Incremental 3D convex hull over a set of coordinates.
+ */
+typedef struct Hull
+{
+    const double *points;  // x, y, z triplets.
+    HullFace *faces;
+    int facesLen;
+    int facesCap;
+    int *freeFaces;  // dead face slots to reuse.
+    int freeLen;
+    int *visible;  // scratch: visible faces of the point being inserted.
+    int *horizon;  // scratch: (from, to, hidden neighbour) triplets of horizon edges.
+    int horizonCap;  // triplets horizon holds.
+    int *startAt;  // scratch: new face whose base edge starts at a vertex.
+    int *endAt;  // scratch: new face whose base edge ends at a vertex.
+    double eps;
+} Hull;
 
 
 /**
@@ -21,195 +588,4301 @@
  * x,y,z coordinates and with them to calculate center mass, orb radius and max distance
  * between 2 atoms of the protein.
  * Prints relevant info upon success and error.
- * @param file the file being processed.
+ * @param source the file being processed.
+ * @param file_name name of the file being processed.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeProtein(const AtomSource *source, const char* file_name, const Options *options,
+                    Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Analyze the pdb text of a buffer. This is the library entry point: it prints nothing and
+ * keeps no state besides the workspace, failures are returned in result->error. Frames are
+ * not split.
+ * @param data the text.
+ * @param len length of the text.
+ * @param options analysis options.
+ * @param workspace buffers to read the atoms into, reused between calls.
+ * @param result output destination.
+ * @return 0 upon success, -1 upon failure, with result->error telling why.
+ */
+int analyzeBuffer(const char *data, size_t len, const Options *options, Workspace *workspace,
+                  ProteinResult *result);
+/**
+ * Analyze and report the pdb text of a buffer, like a file, through analyzeBuffer.
+ * @param data the text.
+ * @param len length of the text.
+ * @param file_name name to report the text by.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between calls.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeText(const char *data, size_t len, const char *file_name, const Options *options,
+                 Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Calculate the data of the atoms read into a stream.
+ * @param stream the atoms.
+ * @param options command line options.
+ * @param result output destination, its error unset.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int calcResult(AtomStream *stream, const Options *options, ProteinResult *result);
+/**
+ * Print why an analysis failed.
+ * @param err stream to print to.
+ * @param error the failure.
+ * @param file_name name of the file that failed.
+ * @param badField the coordinate of a conversionError.
+ */
+void printError(FILE *err, enum ProteinError error, const char *file_name,
+                const char *badField);
+/**
+ * Answer requests until the end of the input, see ARG_ERROR_MSG.
+ * @param in stream of requests.
+ * @param out stream for the responses.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between requests.
+ * @return 0 at the end of the input, -1 if memory allocation failed.
+ */
+int serveStream(FILE *in, FILE *out, const Options *options, Workspace *workspace);
+/**
+ * Serve the connections to a unix socket, each on its own thread, up to MAX_CONNECTIONS at
+ * once. Returns only on failure, after the connections ended and the socket was removed.
+ * @param path path of the socket, replaced if it is a socket and refused if it is anything
+ * else.
+ * @param options command line options.
+ * @return -1, after printing an error.
+ */
+int serveSocket(const char *path, const Options *options);
+/**
+ * Thread routine of serveSocket: serves one connection until the client closes it.
+ * @param arg the Connection, freed by the thread.
+ * @return NULL.
+ */
+void *connectionWorker(void *arg);
+/**
+ * Free the slot of a connection that ended, waking serveSocket if it waits for one.
+ * @param slots the connections being served.
+ */
+void releaseSlot(ConnectionSlots *slots);
+/**
+ * Time the stages of the analysis on synthetic files and print the results as JSON.
+ * @param options command line options, with the sizes to benchmark.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int runBenchmark(const Options *options);
+/**
+ * Time a stage of the analysis, running it until it took long enough to measure.
+ * @param stage the stage.
+ * @param context argument of the stage.
+ * @return the fastest run, in seconds.
+ */
+double timeStage(void (*stage)(BenchContext *context), BenchContext *context);
+/**
+ * Stages of runBenchmark: parse the text into the workspace, then calculate on it.
+ * @param context the benchmarked file.
+ */
+void benchParse(BenchContext *context);
+void benchCenterMass(BenchContext *context);
+void benchRadius(BenchContext *context);
+void benchDmax(BenchContext *context);
+/**
+ * @return a monotonic time, in seconds.
+ */
+double seconds(void);
+/**
+ * Generate the text of a pdb file of atoms spread uniformly in a ball, of about the density
+ * of a protein.
+ * @param atoms number of atoms.
+ * @param seed seed of the pseudo random coordinates, the same seed gives the same file.
+ * @param len output destination, length of the text.
+ * @return the text, to free, or NULL if memory allocation failed.
+ */
+char *syntheticPdb(int atoms, uint64_t seed, size_t *len);
+/**
+ * @param state state of the generator, advanced.
+ * @return a pseudo random number in [0, 1).
+ */
+double nextRandom(uint64_t *state);
+/**
+ * Analyze a regular file through its cache file, creating the cache file if it is missing or
+ * belongs to a different version of the file.
+ * @param file the pdb file.
+ * @param file_name name of the pdb file.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ * @return 0 if the file was analyzed or an error printed, 1 if the file can not be cached.
+ */
+int analyzeCached(FILE *file, const char *file_name, const Options *options,
+                  Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Map a cache file if it is valid for a pdb file of its size. Its time and checksum are
+ * left to the caller.
+ * @param path the cache file.
+ * @param header expected header, with any atom count, time and checksum.
+ * @param cords output destination, a view of the mapped arrays.
+ * @param mapLen output destination, length of the mapping.
+ * @return the mapping, or NULL if the cache file is missing or invalid.
+ */
+void *mapCache(const char *path, const CacheHeader *header, CordStore *cords, size_t *mapLen);
+/**
+ * Write a cache file, through a temporary file so readers never see a partial one. Failures
+ * are ignored, as the cache is only an optimization.
+ * @param path the cache file.
+ * @param header header to write, with the atom count.
+ * @param cords the atoms.
+ * @param mode permissions of the cache file.
+ */
+void writeCache(const char *path, const CacheHeader *header, const CordStore *cords,
+                mode_t mode);
+/**
+ * Analyze all the atoms of a file, already in memory.
+ * @param all the atoms. Used as is unless streaming, which replays them into frameCords.
+ * @param file_name name of the file.
+ * @param options command line options.
+ * @param workspace buffers to stream the atoms into.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int analyzeCords(CordStore *all, const char *file_name, const Options *options,
+                 Workspace *workspace, FILE *out, FILE *err);
+/**
+ * @param atoms number of atoms.
+ * @return size in bytes of a padded coordinate array, as in a CordStore or cache file.
+ */
+size_t axisBytes(int atoms);
+/**
+ * @param data file contents.
+ * @param len length of data.
+ * @return crc32 of the contents.
+ */
+uint32_t checksum(const char *data, size_t len);
+/**
+ * Calculate and report the data of the atoms read into a stream.
+ * @param stream the atoms.
  * @param file_name name of the file being processed.
+ * @param model number of the model the atoms belong to, 0 for a whole file.
+ * @param options command line options.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeStream(AtomStream *stream, const char *file_name, int model,
+                   const Options *options, FILE *out, FILE *err);
+/**
+ * Report a result, and the pair counts of its atoms if the options ask for them.
+ * @param cords the atoms of the result.
+ * @param file_name name of the file being processed.
+ * @param model number of the model the atoms belong to, 0 for a whole file.
+ * @param options command line options.
+ * @param result the result.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void reportResult(const CordStore *cords, const char *file_name, int model,
+                  const Options *options, const ProteinResult *result, FILE *out, FILE *err);
+/**
+ * Analyzes every model of a file, parsing the next model while the current one is
+ * analyzed.
+ * @param source the file being processed.
+ * @param file_name name of the file being processed.
+ * @param options command line options.
+ * @param workspace buffers to read the models into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeFrames(const AtomSource *source, const char* file_name, const Options *options,
+                   Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Hand the frame parsed so far to the analysis and switch to the other stream, once its
+ * analysis is done.
+ * @param frames the pipeline.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int endFrame(FramePipeline *frames);
+/**
+ * Thread routine of analyzeFrames: analyzes the frames in the order they are handed over.
+ * @param arg the FramePipeline.
+ * @return NULL.
+ */
+void *frameAnalyzer(void *arg);
+/**
+ * Analyze a gzip file, or each pdb file of a zip archive.
+ * @param file the compressed file.
+ * @param file_name name of the file.
+ * @param zip true for a zip archive, false for a gzip file.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeCompressed(FILE *file, const char *file_name, bool zip, const Options *options,
+                       Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Analyze each member of a memory mapped zip archive.
+ * @param inflater inflater to reuse for the members.
+ * @param data the archive.
+ * @param len length of the archive.
+ * @param file_name name of the archive.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeZip(Inflater *inflater, const unsigned char *data, size_t len,
+                const char *file_name, const Options *options, Workspace *workspace,
+                FILE *out, FILE *err);
+/**
+ * Decompress on a second thread and analyze the decompressed text.
+ * @param inflater the inflater, with its source set.
+ * @param file_name name to report the data by.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void analyzeInflated(Inflater *inflater, const char *file_name, const Options *options,
+                     Workspace *workspace, FILE *out, FILE *err);
+/**
+ * Thread routine of an Inflater: fills free chunks until the data ends or the reader
+ * cancels.
+ * @param arg the Inflater.
+ * @return NULL.
+ */
+void *inflateWorker(void *arg);
+/**
+ * Decompress the next chunk of data.
+ * @param inflater the inflater.
+ * @param dest output destination, of READ_BLOCK bytes.
+ * @return number of bytes written, 0 at the end of the data or upon corrupt data.
+ */
+size_t inflateChunk(Inflater *inflater, char *dest);
+/**
+ * Read decompressed data, waiting for the inflater thread when no chunk is ready.
+ * @param context the Inflater.
+ * @param dest output destination.
+ * @param max length of dest.
+ * @return number of bytes read, 0 at the end of the data.
+ */
+size_t inflaterRead(void *context, char *dest, size_t max);
+/**
+ * fread for readBlocks.
+ * @param context the FILE.
+ * @param dest output destination.
+ * @param max length of dest.
+ * @return number of bytes read, 0 at the end of the file.
+ */
+size_t fileRead(void *context, char *dest, size_t max);
+/**
+ * gzread for readBlocks, decompressing in the calling thread.
+ * @param context the gzFile.
+ * @param dest output destination.
+ * @param max length of dest.
+ * @return number of bytes read, 0 at the end of the data or upon corrupt data, which gzerror
+ * tells apart.
+ */
+size_t gzipRead(void *context, char *dest, size_t max);
+/**
+ * @param bytes start of a little endian number.
+ * @param len size of the number in bytes, up to 4.
+ * @return the number.
+ */
+unsigned long readLittleEndian(const unsigned char *bytes, int len);
+/**
+ * Open a pdb file and analyze it.
+ * @param file_name name of the file.
+ * @param options command line options.
+ * @param workspace buffers to read the atoms into, reused between files.
+ * @param out stream for the report.
+ * @param err stream for error messages.
+ */
+void processFile(const char *file_name, const Options *options, Workspace *workspace,
+                 FILE *out, FILE *err);
+/**
+ * Tell the format of a file from its first bytes. Only regular files are sniffed, so pipes
+ * keep their first bytes and are read as plain text.
+ * @param file the file, at its start.
+ * @return the format.
  */
-void analyzeProtein(FILE *file, const char* file_name);
+enum FileFormat sniffFormat(FILE *file);
 /**
- * extract from the given line its coordinates: x, y, z and cast them to float.
+ * Allocate the buffers of a thread.
+ * @param workspace the buffers.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int initWorkspace(Workspace *workspace);
+/**
+ * Free the buffers of a thread.
+ * @param workspace the buffers.
+ */
+void freeWorkspace(Workspace *workspace);
+/**
+ * Analyze the files on a number of threads, printing their reports in the given order.
+ * @param fileNames the files.
+ * @param filesLen number of files.
+ * @param options command line options.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int processFilesParallel(char *fileNames[], int filesLen, const Options *options);
+/**
+ * Thread routine of processFilesParallel: analyzes files into memory buffers until none
+ * are left.
+ * @param arg the FileQueue.
+ * @return NULL.
+ */
+void *fileWorker(void *arg);
+/**
+ * Parse the options given before the pdb files.
+ * @param argc number of arguments.
+ * @param argv the arguments.
+ * @param options output destination.
+ * @return index of the first pdb file in argv, -1 upon an unknown option.
+ */
+int parseOptions(int argc, char *argv[], Options *options);
+/**
+ * Convert an option value to a positive int.
+ * @param convertMe the value.
+ * @param dest the converted value (output).
+ * @return 0 upon success, -1 if the value is not a positive int.
+ */
+int stringToPositive(const char *convertMe, int *dest);
+/**
+ * Convert a comma separated list of numbers of atoms.
+ * @param convertMe the list.
+ * @param sizes output destination, of BENCH_MAX_SIZES.
+ * @param sizesLen output destination, the number of sizes.
+ * @return 0 upon success, -1 if the list is empty, too long or not of positive ints.
+ */
+int parseSizes(const char *convertMe, int *sizes, int *sizesLen);
+/**
+ * Convert an option value to a positive float.
+ * @param convertMe the value.
+ * @param dest the converted value (output).
+ * @param end output destination, the character the value ends at. NULL if the whole
+ *            string is the value.
+ * @return 0 upon success, -1 if the value is not a positive number.
+ */
+int stringToDistance(const char *convertMe, float *dest, const char **end);
+/**
+ * @param arg a command line argument.
+ * @param option option name, including its '='.
+ * @return the value given to the option, NULL if arg is not this option.
+ */
+const char *optionValue(const char *arg, const char *option);
+/**
+ * Pick the kernels for an instruction set.
+ * @param name one of the KERNEL_ names. auto picks the best one supported by the CPU.
+ * @return the kernels, NULL if name is unknown or not supported by the CPU.
+ */
+const Kernels *selectKernels(const char *name);
+/**
+ * Allocate an empty coordinate store.
+ * @param cords the store to initialize.
+ * @param cap number of atoms it can hold.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int initCordStore(CordStore *cords, int cap);
+/**
+ * Append an atom to the store, growing it when full.
+ * @param cords the store.
+ * @param cord x, y, z of the atom.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int pushCord(CordStore *cords, const float cord[3]);
+/**
+ * Double the capacity of the store, keeping its atoms.
+ * @param cords the store.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int growCordStore(CordStore *cords);
+/**
+ * Free the arrays of the store.
+ * @param cords the store.
+ */
+void freeCordStore(CordStore *cords);
+/**
+ * Scalar kernels, see Kernels.
+ */
+void sumScalar(const CordStore *cords, double sums[3]);
+void squaresScalar(const CordStore *cords, const double center[3], double sums[3]);
+float maxDistanceScalar(const CordStore *cords, int from, int to, const float p[3]);
+void covarianceScalar(const CordStore *a, const CordStore *b, double cov[9]);
+#ifdef X86_KERNELS
+/**
+ * SSE2 kernels, see Kernels.
+ */
+void sumSse(const CordStore *cords, double sums[3]);
+void squaresSse(const CordStore *cords, const double center[3], double sums[3]);
+float maxDistanceSse(const CordStore *cords, int from, int to, const float p[3]);
+void covarianceSse(const CordStore *a, const CordStore *b, double cov[9]);
+/**
+ * AVX2 kernels, see Kernels.
+ */
+void sumAvx2(const CordStore *cords, double sums[3]);
+void squaresAvx2(const CordStore *cords, const double center[3], double sums[3]);
+float maxDistanceAvx2(const CordStore *cords, int from, int to, const float p[3]);
+void covarianceAvx2(const CordStore *a, const CordStore *b, double cov[9]);
+#endif
+/**
+ * Read the atoms of a pdb file. Regular files are memory mapped and parsed in place, other
+ * sources are read in blocks.
+ * @param source the file.
+ * @param stream output destination.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int readAtoms(const AtomSource *source, AtomStream *stream);
+/**
+ * Read and parse the atoms of a source one block at a time, carrying an incomplete last
+ * line over to the next block.
+ * @param stream output destination.
+ * @param read reads up to max bytes from context into dest, returns 0 at the end.
+ * @param context the source.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int readBlocks(AtomStream *stream, size_t (*read)(void *context, char *dest, size_t max),
+               void *context);
+/**
+ * Prepare a destination for the atoms of a file, according to the options.
+ * @param stream the destination.
+ * @param options command line options.
+ * @param cords store for the atoms that are kept.
+ */
+void initAtomStream(AtomStream *stream, const Options *options, CordStore *cords);
+/**
+ * Add a parsed atom.
+ * @param stream the destination.
+ * @param cord x, y, z of the atom.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int addAtom(AtomStream *stream, const float cord[3]);
+/**
+ * Filter the atoms kept since the last filtering, once all atoms were added.
+ * @param stream the destination.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int finishAtomStream(AtomStream *stream);
+/**
+ * Update the extreme atoms with the unfiltered block, and drop the kept atoms strictly
+ * inside their convex hull.
+ * @param stream the destination.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int filterBlock(AtomStream *stream);
+/**
+ * Add an atom to running stats.
+ * @param stats the stats.
+ * @param cord x, y, z of the atom.
+ */
+void updateStats(AtomStats *stats, const float cord[3]);
+/**
+ * Center mass and orb radius of the atoms added to running stats.
+ * @param stats the stats.
+ * @param centerMass output destination, array of len 3.
+ * @param radius output destination.
+ */
+void statsResult(const AtomStats *stats, float *centerMass, float *radius);
+/**
+ * Parse the ATOM records of the complete lines in a buffer.
+ * @param data the buffer.
+ * @param len length of the buffer.
+ * @param final true if no more data follows, so the last line is complete even without
+ * a newline.
+ * @param stream output destination.
+ * @return number of bytes parsed, up to the start of an incomplete last line. -1 if memory
+ * allocation failed.
+ */
+long parseAtoms(const char *data, size_t len, bool final, AtomStream *stream);
+/**
+ * extract from the given line its coordinates: x, y, z (columns 31-54) and cast them to
+ * float.
  * @param line the line to read from.
+ * @param lineLen length of the line, without its newline.
  * @param cords array of floats, size = 3, for output.
+ * @param badField output destination, of CORD_WIDTH + 1 chars, for a field that is not a
+ *                 number.
+ * @return 0 upon success, -1 if a field is not a number.
  */
-void extractCords(const char *line, float* cords);
+int extractCords(const char *line, size_t lineLen, float cords[3], char *badField);
+/**
+ * Decode a fixed width coordinate field such as "  -4.890" without copying it.
+ * @param field start of the field.
+ * @param len width of the field.
+ * @param dest the decoded value (output).
+ * @return 0 upon success, -1 if the field is not a plain decimal number.
+ */
+int decodeCord(const char *field, int len, float *dest);
 /**
  * Calculate center mass of a protein.
- * @param cords All atom's coordinates in 2d array of floats.
- * @param cordsLen len of the first dimention of cords.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to sum with.
+ * @param threads number of threads to use, which does not change the result.
  * @param centerMass output destination . centerMass array of len 3 of floats.
  */
-void calCenterMass(float cords[][3], const int *cordsLen, float *centerMass);
+void calCenterMass(const CordStore *cords, const Kernels *kernels, int threads,
+                   float *centerMass);
 /**
  * Calc Orb radius of a protein.
- * @param cords All atom's coordinates in 2d array of floats.
- * @param cordsLen len of the first dimention of cords.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to sum with.
+ * @param threads number of threads to use, which does not change the result.
  * @param centerMass array of len 3 of floats.
  * @param radius output destination of the calculation.
  */
-void calcRadius(float cords[][3], const int *cordsLen, const float *centerMass, float *radius);
+void calcRadius(const CordStore *cords, const Kernels *kernels, int threads,
+                const float *centerMass, float *radius);
 /**
- * Calculate max distance between 3D points.
- * @param cords 2D array of all atoms.
- * @param cordsLen number of cords in the array.
- * @param dMax output param to fill.
- * @return
+ * Sum the coordinates, or their squared deviations from a center, in blocks of REDUCE_BLOCK
+ * atoms. Blocks are summed in double by the kernels and combined in order with compensated
+ * (Kahan-Babuska) summation, so the result is the same for any number of threads.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to sum with.
+ * @param center NULL to sum the coordinates, otherwise the center to sum squares around.
+ * @param threads number of threads to use, including the calling one.
+ * @param sums output destination, the sum of each axis.
  */
-void calcDmax(float cords[][3], const int *cordsLen, float *dMax);
+void reduceBlocks(const CordStore *cords, const Kernels *kernels, const double *center,
+                  int threads, double sums[3]);
 /**
- * Print to screen various info of the protein described in file.
- * @param file_name name of the file being read.
- * @param atoms number of atoms read from file.
- * @param radius average circular radius
- * @param dMax max distance between 2 coordinates
- * @param centerMass protein center mass
+ * Thread routine of reduceBlocks: sums blocks until none are left.
+ * @param arg the Reduction.
+ * @return NULL.
  */
-void report(const char *file_name, const int *atoms, const float *radius,
-            const float *dMax, const float centerMass[]);
+void *reductionWorker(void *arg);
 /**
- * Cast string to float.
- * @param convertMe the string to convert
- * @param dest the converted string (output)
+ * Sum a block of a reduction.
+ * @param reduction the reduction.
+ * @param b index of the block.
+ * @param sums output destination, the sum of each axis over the block.
  */
-void stringToFloat(const char convertMe[], float* dest);
+void sumBlock(const Reduction *reduction, int b, double sums[3]);
+/**
+ * Add to a sum, keeping the rounding error of the addition apart (Neumaier).
+ * @param sum the sum.
+ * @param compensation the rounding errors so far, added to the sum at the end.
+ * @param value the value to add.
+ */
+void addCompensated(double *sum, double *compensation, double value);
+/**
+ * Calculate max distance between 3D points. Compares squared distances and takes a single
+ * square root at the end.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to measure distances with.
+ * @param dMax output param to fill.
+ */
+void calcDmax(const CordStore *cords, const Kernels *kernels, float *dMax);
+/**
+ * Calculate max distance between 3D points by searching only the vertices of their convex
+ * hull, where the farthest pair must lie. Falls back to calcDmax for flat inputs.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to measure distances with.
+ * @param dMax output param to fill.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int calcDmaxHull(const CordStore *cords, const Kernels *kernels, float *dMax);
+/**
+ * Calculate max distance between 3D points comparing all pairs, like calcDmax, split into
+ * cache sized tiles that are shared by a number of threads.
+ * @param cords All atom's coordinates.
+ * @param kernels kernels to measure distances with.
+ * @param threads number of threads to use, including the calling one.
+ * @param dMax output param to fill.
+ */
+void calcDmaxTiled(const CordStore *cords, const Kernels *kernels, int threads, float *dMax);
+/**
+ * Thread routine of calcDmaxTiled: takes tiles from the queue until it is empty.
+ * @param arg the TileWorker of the thread.
+ * @return NULL.
+ */
+void *tileWorker(void *arg);
+/**
+ * Max squared distance between the atoms of 2 tiles.
+ * @param queue the tiled computation.
+ * @param tile index of the tile, in row major order of the lower triangle.
+ * @return the distance.
+ */
+float tileMax(const TileQueue *queue, long tile);
+/**
+ * Find the vertices of the convex hull of the given points.
+ * @param points the points, as x, y, z triplets of doubles.
+ * @param pointsLen number of points.
+ * @param vertices output destination, of len pointsLen. filled with indices of hull vertices.
+ * @param verticesLen number of vertices found (output).
+ * @return 0 upon success, 1 if the points are flat or too close to flat for a consistent hull,
+ * -1 if memory allocation failed.
+ */
+int hullVertices(const double *points, int pointsLen, int *vertices, int *verticesLen);
+/**
+ * Allocate a hull and build its initial tetrahedron from the extreme points.
+ * @param hull the hull to initialize. freeHull it whatever the result.
+ * @param points the points, as x, y, z triplets of doubles.
+ * @param pointsLen number of points.
+ * @return 0 upon success, 1 if the points are flat (thinner than HULL_FLAT of their
+ * diameter), -1 if memory allocation failed.
+ */
+int initHull(Hull *hull, const double *points, int pointsLen);
+/**
+ * Insert a point to the hull, replacing the faces it sees. The visible faces are grown from
+ * the farthest one over their neighbours, so they are connected, and their horizon must be a
+ * single cycle of edges the new faces keep convex.
+ * @param hull the hull.
+ * @param p index of the point to insert.
+ * @return 0 upon success, 1 if rounding made the hull inconsistent, which leaves it unusable,
+ * -1 if memory allocation failed.
+ */
+int hullInsert(Hull *hull, int p);
+/**
+ * Check that the horizon edges make a single cycle, each vertex starting and ending one edge.
+ * Marks the edge each horizon vertex starts in hull->startAt.
+ * @param hull the hull.
+ * @param horizonLen number of horizon edges.
+ * @return true if the horizon is a single cycle.
+ */
+bool horizonIsCycle(Hull *hull, int horizonLen);
+/**
+ * Add a face to the hull, reusing a dead slot if there is one.
+ * @param hull the hull.
+ * @param a first vertex.
+ * @param b second vertex.
+ * @param c third vertex.
+ * @return index of the new face, -1 if memory allocation failed.
+ */
+int hullAddFace(Hull *hull, int a, int b, int c);
+/**
+ * Signed distance of a point from the plane of a face. Positive is outside.
+ * @param hull the hull.
+ * @param face the face.
+ * @param p index of the point.
+ * @return the distance.
+ */
+double faceDistance(const Hull *hull, const HullFace *face, int p);
+/**
+ * Signed distance of a point from the plane of a face. Positive is outside.
+ * @param face the face.
+ * @param point x, y, z of the point.
+ * @return the distance.
+ */
+double planeDistance(const HullFace *face, const double point[3]);
+/**
+ * One of the EXTREME_DIRECTIONS directions to the corners, edges and faces of a cube.
+ * @param e index of the direction.
+ * @param d the direction (output).
+ */
+void extremeDirection(int e, double d[3]);
+/**
+ * Free all memory held by the hull.
+ * @param hull the hull.
+ */
+void freeHull(Hull *hull);
+/**
+ * Read every file, superpose every pair of them and print the matrix of their RMSDs.
+ * @param fileNames the files, which must have the same number of atoms.
+ * @param filesLen number of files.
+ * @param options command line options.
+ * @return 0 upon success, -1 upon failure, after printing an error.
+ */
+int rmsdMatrix(char *fileNames[], int filesLen, const Options *options);
+/**
+ * Read all the atoms of a file, plain or gzip compressed. Zip archives are refused, as
+ * their members are not one structure.
+ * @param file_name the file.
+ * @param options command line options.
+ * @param cords output destination, an initialized store.
+ * @return 0 upon success, -1 upon failure, after printing an error.
+ */
+int loadStructure(const char *file_name, const Options *options, CordStore *cords);
+/**
+ * Thread routine of rmsdMatrix: takes pairs from the queue until it is empty.
+ * @param arg the RmsdQueue.
+ * @return NULL.
+ */
+void *rmsdWorker(void *arg);
+/**
+ * RMSD of 2 centered structures after optimal rotation, found as the largest eigenvalue of
+ * the quaternion key matrix by Newton iteration on its characteristic polynomial (QCP).
+ * @param cov covariance of the structures, see Kernels.
+ * @param norms sum of the squared coordinates of both structures.
+ * @param atoms number of atoms of each structure.
+ * @return the RMSD.
+ */
+double qcpRmsd(const double cov[9], double norms, int atoms);
+/**
+ * Find the row and column of an index into the lower triangle of a matrix, diagonal
+ * included, in row major order.
+ * @param index the index.
+ * @param row output destination.
+ * @param col output destination.
+ */
+void triangleCell(long index, long *row, long *col);
+/**
+ * Count the contacts and the distance histogram of the atoms, using a cell list so only
+ * pairs in adjacent cells are measured.
+ * @param cords All atom's coordinates.
+ * @param counts output destination, with its ranges and zeroed bins set.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int calcPairs(const CordStore *cords, PairCounts *counts);
+/**
+ * Sort the atoms into a grid of cells.
+ * @param cells the cell list to build. freeCellList it whatever the result.
+ * @param cords the atoms, at least one.
+ * @param range the longest distance that will be searched.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int initCellList(CellList *cells, const CordStore *cords, float range);
+/**
+ * Count the pairs of atoms of 2 cells.
+ * @param cells the cell list.
+ * @param a first cell.
+ * @param b second cell, a itself to count the pairs inside a.
+ * @param counts counts to add to.
+ */
+void countCellPairs(const CellList *cells, int a, int b, PairCounts *counts);
+/**
+ * @param cells the cell list to free.
+ */
+void freeCellList(CellList *cells);
+/**
+ * Print the contacts and histogram requested by the options.
+ * @param out stream to print to.
+ * @param options command line options.
+ * @param counts the counts.
+ */
+void reportPairs(FILE *out, const Options *options, const PairCounts *counts);
+/**
+ * Print to screen various info of the protein described in file.
+ * @param out stream to print to.
+ * @param file_name name of the file being read.
+ * @param model number of the model described, 0 for a whole file.
+ * @param atoms number of atoms read from file.
+ * @param radius average circular radius
+ * @param dMax max distance between 2 coordinates, NULL if it was not calculated.
+ * @param centerMass protein center mass
+ */
+void report(FILE *out, const char *file_name, int model, const int *atoms,
+            const float *radius, const float *dMax, const float centerMass[]);
+/**
+ * Cast string to float.
+ * @param convertMe the string to convert
+ * @param dest the converted string (output)
+ * @return 0 upon success, -1 if the string is not a number.
+ */
+int stringToFloat(const char convertMe[], float* dest);
+
+
+int main(int argc, char* argv[])
+{
+    if(argc <= 1)
+    {
+        fprintf(stderr, ARG_ERROR_MSG);
+        exit(EXIT_FAILURE);
+    }
+
+    Options options;
+    int first = parseOptions(argc, argv, &options);
+    bool fileless = options.serve || options.benchSizesLen > 0 || options.generate > 0;
+    if(first < 0 || (first == argc) != fileless)
+    {
+        fprintf(stderr, ARG_ERROR_MSG);
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.generate > 0)
+    {
+        size_t len;
+        char *text = syntheticPdb(options.generate, BENCH_SEED, &len);
+        if(text == NULL)
+        {
+            fprintf(stderr, MEM_FAULT_MSG);
+            exit(EXIT_FAILURE);
+        }
+        fwrite(text, 1, len, stdout);
+        free(text);
+        return 0;
+    }
+    if(options.benchSizesLen > 0)
+    {
+        if(runBenchmark(&options) < 0)
+        {
+            fprintf(stderr, MEM_FAULT_MSG);
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+
+    if(options.socketPath != NULL)
+    {
+        serveSocket(options.socketPath, &options);
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.rmsd != noRmsd)
+    {
+        if(rmsdMatrix(argv + first, argc - first, &options) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+    if(options.threads > 1 && argc - first > 1)
+    {
+        if(processFilesParallel(argv + first, argc - first, &options) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+    Workspace workspace;
+    if(initWorkspace(&workspace) < 0)
+    {
+        fprintf(stderr, MEM_FAULT_MSG);
+        exit(EXIT_FAILURE);
+    }
+    int retVal = 0;
+    if(options.serve)
+    {
+        retVal = serveStream(stdin, stdout, &options, &workspace);
+    }
+    for (int i = first; i < argc; i++)
+    {
+        processFile(argv[i], &options, &workspace, stdout, stderr);
+    }
+    freeWorkspace(&workspace);
+    if(retVal < 0)
+    {
+        fprintf(stderr, MEM_FAULT_MSG);
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+
+int runBenchmark(const Options *options)
+{
+    static const char *dmaxNames[] = {DMAX_HULL, DMAX_BRUTE, DMAX_TILED};
+    Workspace workspace;
+    if(initWorkspace(&workspace) < 0)
+    {
+        return -1;
+    }
+    Options plain = *options;
+    plain.stream = false;  // time the stages apart, on all the atoms.
+    printf(BENCH_JSON_START, options->kernels->name, dmaxNames[options->dmaxMode],
+           options->threads);
+    int retVal = 0;
+    for(int i = 0; i < options->benchSizesLen && retVal == 0; i++)
+    {
+        int atoms = options->benchSizes[i];
+        BenchContext context;
+        memset(&context, 0, sizeof(BenchContext));
+        context.data = syntheticPdb(atoms, BENCH_SEED, &context.len);
+        context.options = &plain;
+        context.workspace = &workspace;
+        if(context.data == NULL)
+        {
+            retVal = -1;
+            break;
+        }
+        double parse = timeStage(benchParse, &context);
+        double centerMass = timeStage(benchCenterMass, &context);
+        double radius = timeStage(benchRadius, &context);
+        printf(i > 0 ? ",\n" BENCH_JSON_RESULT : BENCH_JSON_RESULT, atoms, context.len, parse,
+               atoms / parse, centerMass, atoms / centerMass, radius, atoms / radius);
+        if(options->dmaxMode != hullDmax && atoms > BENCH_BRUTE_ATOMS)
+        {
+            printf(BENCH_JSON_NO_DMAX);
+        }
+        else
+        {
+            double dMax = timeStage(benchDmax, &context);
+            if(options->dmaxMode == hullDmax)
+            {
+                printf(BENCH_JSON_HULL_DMAX, dMax);
+            }
+            else
+            {
+                printf(BENCH_JSON_DMAX, dMax, 0.5 * atoms * (atoms - 1.0) / dMax);
+            }
+        }
+        fflush(stdout);
+        retVal = context.failed ? -1 : 0;
+        free((char*)context.data);
+    }
+    printf(BENCH_JSON_END);
+    freeWorkspace(&workspace);
+    return retVal;
+}
+
+
+double timeStage(void (*stage)(BenchContext *context), BenchContext *context)
+{
+    double best = INFINITY, total = 0;
+    for(int run = 0; run < BENCH_MAX_RUNS && !context->failed &&
+                     (run < BENCH_MIN_RUNS || total < BENCH_MIN_SECONDS); run++)
+    {
+        double start = seconds();
+        stage(context);
+        double elapsed = seconds() - start;
+        best = elapsed < best ? elapsed : best;
+        total += elapsed;
+    }
+    return best;
+}
+
+
+void benchParse(BenchContext *context)
+{
+    AtomStream stream;
+    initAtomStream(&stream, context->options, &context->workspace->cords);
+    context->failed |= parseAtoms(context->data, context->len, true, &stream) < 0;
+}
+
+
+void benchCenterMass(BenchContext *context)
+{
+    calCenterMass(&context->workspace->cords, context->options->kernels, context->options->threads,
+                  context->centerMass);
+}
+
+
+void benchRadius(BenchContext *context)
+{
+    calcRadius(&context->workspace->cords, context->options->kernels, context->options->threads,
+               context->centerMass,
+               &context->result);
+}
+
+
+void benchDmax(BenchContext *context)
+{
+    const CordStore *cords = &context->workspace->cords;
+    const Options *options = context->options;
+    if(options->dmaxMode == bruteDmax)
+    {
+        calcDmax(cords, options->kernels, &context->result);
+    }
+    else if(options->dmaxMode == tiledDmax)
+    {
+        calcDmaxTiled(cords, options->kernels, options->threads, &context->result);
+    }
+    else
+    {
+        context->failed |= calcDmaxHull(cords, options->kernels, &context->result) < 0;
+    }
+}
+
+
+double seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+char *syntheticPdb(int atoms, uint64_t seed, size_t *len)
+{
+    char *text = (char*)malloc(strlen(BENCH_HEADER) + (size_t)atoms * BENCH_LINE_LEN + 1);
+    if(text == NULL)
+    {
+        return NULL;
+    }
+    double radius = cbrt(3.0 * atoms / (4.0 * PI * BENCH_DENSITY));
+    uint64_t state = seed;
+    size_t at = sprintf(text, BENCH_HEADER);
+    for(int i = 0; i < atoms; i++)
+    {
+        double cord[3], squared;
+        do
+        {
+            squared = 0;
+            for(int k = 0; k < 3; k++)
+            {
+                cord[k] = (2 * nextRandom(&state) - 1) * radius;
+                squared += cord[k] * cord[k];
+            }
+        } while(squared > radius * radius);
+        at += snprintf(text + at, BENCH_LINE_LEN + 1, BENCH_ATOM_LINE, i % BENCH_ATOM_SERIALS + 1,
+                       i % BENCH_RESIDUES, cord[0], cord[1], cord[2]);
+    }
+    *len = at;
+    return text;
+}
+
+
+double nextRandom(uint64_t *state)
+{
+    // 64 bit linear congruential generator, its top 53 bits as the fraction.
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+int serveStream(FILE *in, FILE *out, const Options *options, Workspace *workspace)
+{
+    char *line = NULL, *buffer = NULL;
+    size_t lineCap = 0, bufferCap = 0;
+    ssize_t lineLen;
+    int retVal = 0;
+    while(retVal == 0 && (lineLen = getline(&line, &lineCap, in)) > 0)
+    {
+        if(line[lineLen - 1] == '\n')
+        {
+            line[--lineLen] = '\0';
+        }
+        if(strncmp(line, FILE_REQUEST, strlen(FILE_REQUEST)) == 0)
+        {
+            processFile(line + strlen(FILE_REQUEST), options, workspace, out, out);
+        }
+        else if(strncmp(line, BUFFER_REQUEST, strlen(BUFFER_REQUEST)) == 0)
+        {
+            char *name;
+            errno = 0;
+            unsigned long len = strtoul(line + strlen(BUFFER_REQUEST), &name, 10);
+            if(errno != 0 || name == line + strlen(BUFFER_REQUEST) || *name != ' ' ||
+               len > MAX_REQUEST_LEN)
+            {
+                fprintf(out, REQUEST_ERR_MSG, line);
+                break;  // the length of the buffer to skip is unknown, or too long to read.
+            }
+            if(len > bufferCap)
+            {
+                char *grown = (char*)realloc(buffer, len);
+                if(grown == NULL)
+                {
+                    retVal = -1;
+                    break;
+                }
+                buffer = grown;
+                bufferCap = len;
+            }
+            if(fread(buffer, 1, len, in) != len)
+            {
+                break;  // the client left mid buffer.
+            }
+            analyzeText(buffer, len, name + 1, options, workspace, out, out);
+        }
+        else
+        {
+            fprintf(out, REQUEST_ERR_MSG, line);
+        }
+        fputc(END_OF_RESPONSE, out);
+        fflush(out);
+    }
+    free(line);
+    free(buffer);
+    return retVal;
+}
+
+
+int serveSocket(const char *path, const Options *options)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    struct stat info;
+    bool exists = lstat(path, &info) == 0;
+    // only a socket left by an earlier run is replaced, never a file that happens to be there.
+    if(strlen(path) >= sizeof(address.sun_path) || (exists && !S_ISSOCK(info.st_mode)))
+    {
+        fprintf(stderr, SOCKET_ERR_MSG, path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    signal(SIGPIPE, SIG_IGN);  // a client leaving mid response fails the write instead.
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(exists)
+    {
+        unlink(path);
+    }
+    if(listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(listener, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, SOCKET_ERR_MSG, path);
+        if(listener >= 0)
+        {
+            close(listener);
+        }
+        return -1;
+    }
+    ConnectionSlots slots;
+    slots.active = 0;
+    pthread_mutex_init(&slots.lock, NULL);
+    pthread_cond_init(&slots.left, NULL);
+    while(true)
+    {
+        pthread_mutex_lock(&slots.lock);
+        while(slots.active >= MAX_CONNECTIONS)
+        {
+            pthread_cond_wait(&slots.left, &slots.lock);
+        }
+        pthread_mutex_unlock(&slots.lock);
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+        Connection *connection = (Connection*)malloc(sizeof(Connection));
+        pthread_t thread;
+        if(connection == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->options = options;
+        connection->slots = &slots;
+        pthread_mutex_lock(&slots.lock);
+        slots.active++;
+        pthread_mutex_unlock(&slots.lock);
+        if(pthread_create(&thread, NULL, connectionWorker, connection) != 0)
+        {
+            releaseSlot(&slots);
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    fprintf(stderr, SOCKET_ERR_MSG, path);
+    close(listener);
+    unlink(path);
+    // the detached threads use the slots until their clients leave.
+    pthread_mutex_lock(&slots.lock);
+    while(slots.active > 0)
+    {
+        pthread_cond_wait(&slots.left, &slots.lock);
+    }
+    pthread_mutex_unlock(&slots.lock);
+    pthread_cond_destroy(&slots.left);
+    pthread_mutex_destroy(&slots.lock);
+    return -1;
+}
+
+
+void releaseSlot(ConnectionSlots *slots)
+{
+    pthread_mutex_lock(&slots->lock);
+    slots->active--;
+    pthread_cond_broadcast(&slots->left);
+    pthread_mutex_unlock(&slots->lock);
+}
+
+
+void *connectionWorker(void *arg)
+{
+    Connection *connection = (Connection*)arg;
+    int outFd = dup(connection->fd);
+    FILE *in = fdopen(connection->fd, "r");
+    FILE *out = outFd < 0 ? NULL : fdopen(outFd, "w");
+    Workspace workspace;
+    if(in != NULL && out != NULL && initWorkspace(&workspace) == 0)
+    {
+        if(serveStream(in, out, connection->options, &workspace) < 0)
+        {
+            fprintf(out, MEM_FAULT_MSG);
+        }
+        freeWorkspace(&workspace);
+    }
+    if(in != NULL)
+    {
+        fclose(in);
+    }
+    else
+    {
+        close(connection->fd);
+    }
+    if(out != NULL)
+    {
+        fclose(out);
+    }
+    else if(outFd >= 0)
+    {
+        close(outFd);
+    }
+    releaseSlot(connection->slots);
+    free(connection);
+    return NULL;
+}
+
+
+void processFile(const char *file_name, const Options *options, Workspace *workspace,
+                 FILE *out, FILE *err)
+{
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+    {
+        fprintf(err, FILE_NOT_FOUND_MSG, file_name);
+        return;
+    }
+    enum FileFormat format = sniffFormat(file);
+    if(format == plainFormat)
+    {
+        AtomSource source = {file, NULL};
+        analyzeProtein(&source, file_name, options, workspace, out, err);
+    }
+    else
+    {
+        analyzeCompressed(file, file_name, format == zipFormat, options, workspace, out, err);
+    }
+    fclose(file);
+}
+
+
+enum FileFormat sniffFormat(FILE *file)
+{
+    // only seekable files are sniffed, so pipes keep their first bytes.
+    struct stat info;
+    char magic[MAGIC_LEN] = "";
+    size_t magicLen = 0;
+    if(fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode))
+    {
+        magicLen = fread(magic, 1, MAGIC_LEN, file);
+        rewind(file);
+    }
+    if(magicLen >= GZIP_MAGIC_LEN && memcmp(magic, GZIP_MAGIC, GZIP_MAGIC_LEN) == 0)
+    {
+        return gzipFormat;
+    }
+    if(magicLen == MAGIC_LEN && memcmp(magic, ZIP_MAGIC, MAGIC_LEN) == 0)
+    {
+        return zipFormat;
+    }
+    return plainFormat;
+}
+
+
+void analyzeCompressed(FILE *file, const char *file_name, bool zip, const Options *options,
+                       Workspace *workspace, FILE *out, FILE *err)
+{
+    Inflater *inflater = (Inflater*)malloc(sizeof(Inflater));
+    if(inflater == NULL)
+    {
+        fprintf(err, MEM_FAULT_MSG);
+        return;
+    }
+    inflater->gz = NULL;
+    if(!zip)
+    {
+        int fd = dup(fileno(file));
+        inflater->gz = fd < 0 ? NULL : gzdopen(fd, "rb");
+        if(inflater->gz == NULL)
+        {
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+            fprintf(err, MEM_FAULT_MSG);
+        }
+        else
+        {
+            analyzeInflated(inflater, file_name, options, workspace, out, err);
+            gzclose(inflater->gz);
+        }
+        free(inflater);
+        return;
+    }
+    struct stat info;
+    unsigned char *data = MAP_FAILED;
+    if(fstat(fileno(file), &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    }
+    if(data == MAP_FAILED)
+    {
+        fprintf(err, ARCHIVE_ERR_MSG, file_name);
+    }
+    else
+    {
+        analyzeZip(inflater, data, info.st_size, file_name, options, workspace, out, err);
+        munmap(data, info.st_size);
+    }
+    free(inflater);
+}
+
+
+void analyzeZip(Inflater *inflater, const unsigned char *data, size_t len,
+                const char *file_name, const Options *options, Workspace *workspace,
+                FILE *out, FILE *err)
+{
+    // the central directory is found through the end record, behind an optional comment.
+    long end = (long)len - ZIP_END_LEN;
+    while(end >= 0 && (long)len - end - ZIP_END_LEN <= ZIP_MAX_COMMENT &&
+          readLittleEndian(data + end, 4) != ZIP_END_SIGNATURE)
+    {
+        end--;
+    }
+    if(end < 0 || readLittleEndian(data + end, 4) != ZIP_END_SIGNATURE)
+    {
+        fprintf(err, ARCHIVE_ERR_MSG, file_name);
+        return;
+    }
+    unsigned long members = readLittleEndian(data + end + 10, 2);
+    size_t entry = readLittleEndian(data + end + 16, 4);
+    for(unsigned long m = 0; m < members; m++)
+    {
+        if(entry + ZIP_CENTRAL_LEN > len ||
+           readLittleEndian(data + entry, 4) != ZIP_CENTRAL_SIGNATURE)
+        {
+            fprintf(err, ARCHIVE_ERR_MSG, file_name);
+            return;
+        }
+        int method = (int)readLittleEndian(data + entry + 10, 2);
+        size_t compressedLen = readLittleEndian(data + entry + 20, 4);
+        int nameLen = (int)readLittleEndian(data + entry + 28, 2);
+        size_t local = readLittleEndian(data + entry + 42, 4);
+        const char *name = (const char*)data + entry + ZIP_CENTRAL_LEN;
+        size_t next = entry + ZIP_CENTRAL_LEN + nameLen + readLittleEndian(data + entry + 30, 2) +
+                      readLittleEndian(data + entry + 32, 2);
+        if(next > len || local + ZIP_LOCAL_LEN > len ||
+           readLittleEndian(data + local, 4) != ZIP_LOCAL_SIGNATURE)
+        {
+            fprintf(err, ARCHIVE_ERR_MSG, file_name);
+            return;
+        }
+        size_t start = local + ZIP_LOCAL_LEN + readLittleEndian(data + local + 26, 2) +
+                       readLittleEndian(data + local + 28, 2);
+        entry = next;
+        if(nameLen > 0 && name[nameLen - 1] == '/')
+        {
+            continue;  // a directory.
+        }
+        size_t memberNameLen = strlen(file_name) + nameLen + 2;
+        char *memberName = (char*)malloc(memberNameLen);
+        if(memberName == NULL)
+        {
+            fprintf(err, MEM_FAULT_MSG);
+            return;
+        }
+        snprintf(memberName, memberNameLen, ZIP_MEMBER_NAME, file_name, nameLen, name);
+        if(start > len || compressedLen > len - start)
+        {
+            fprintf(err, ARCHIVE_ERR_MSG, memberName);
+        }
+        else if(method != ZIP_STORED && method != ZIP_DEFLATED)
+        {
+            fprintf(err, COMPRESSION_ERR_MSG, memberName);
+        }
+        else
+        {
+            inflater->data = data + start;
+            inflater->dataLen = compressedLen;
+            inflater->method = method;
+            analyzeInflated(inflater, memberName, options, workspace, out, err);
+        }
+        free(memberName);
+    }
+}
+
+
+void analyzeInflated(Inflater *inflater, const char *file_name, const Options *options,
+                     Workspace *workspace, FILE *out, FILE *err)
+{
+    inflater->head = 0;
+    inflater->offset = 0;
+    inflater->filled = 0;
+    inflater->done = false;
+    inflater->failed = false;
+    inflater->cancelled = false;
+    inflater->ended = false;
+    if(inflater->gz == NULL)
+    {
+        memset(&inflater->zip, 0, sizeof(z_stream));
+        inflater->zip.next_in = (Bytef*)inflater->data;
+        inflater->zip.avail_in = (uInt)inflater->dataLen;
+        if(inflater->method == ZIP_DEFLATED && inflateInit2(&inflater->zip, -MAX_WBITS) != Z_OK)
+        {
+            fprintf(err, MEM_FAULT_MSG);
+            return;
+        }
+    }
+    pthread_mutex_init(&inflater->lock, NULL);
+    pthread_cond_init(&inflater->changed, NULL);
+    if(pthread_create(&inflater->thread, NULL, inflateWorker, inflater) != 0)
+    {
+        fprintf(err, MEM_FAULT_MSG);
+    }
+    else
+    {
+        AtomSource source = {NULL, inflater};
+        analyzeProtein(&source, file_name, options, workspace, out, err);
+        pthread_mutex_lock(&inflater->lock);
+        inflater->cancelled = true;
+        pthread_cond_broadcast(&inflater->changed);
+        pthread_mutex_unlock(&inflater->lock);
+        pthread_join(inflater->thread, NULL);
+    }
+    pthread_cond_destroy(&inflater->changed);
+    pthread_mutex_destroy(&inflater->lock);
+    if(inflater->gz == NULL && inflater->method == ZIP_DEFLATED)
+    {
+        inflateEnd(&inflater->zip);
+    }
+}
+
+
+void *inflateWorker(void *arg)
+{
+    Inflater *inflater = (Inflater*)arg;
+    pthread_mutex_lock(&inflater->lock);
+    while(!inflater->done)
+    {
+        while(inflater->filled == INFLATE_CHUNKS && !inflater->cancelled)
+        {
+            pthread_cond_wait(&inflater->changed, &inflater->lock);
+        }
+        if(inflater->cancelled)
+        {
+            break;
+        }
+        int chunk = (inflater->head + inflater->filled) % INFLATE_CHUNKS;
+        pthread_mutex_unlock(&inflater->lock);
+        size_t len = inflateChunk(inflater, inflater->chunks[chunk]);
+        pthread_mutex_lock(&inflater->lock);
+        inflater->lens[chunk] = len;
+        inflater->filled += len > 0;
+        inflater->done = len == 0;
+        pthread_cond_broadcast(&inflater->changed);
+    }
+    pthread_mutex_unlock(&inflater->lock);
+    return NULL;
+}
+
+
+size_t inflateChunk(Inflater *inflater, char *dest)
+{
+    if(inflater->gz != NULL)
+    {
+        int len = gzread(inflater->gz, dest, READ_BLOCK);
+        inflater->failed = len < 0;
+        return len < 0 ? 0 : (size_t)len;
+    }
+    z_stream *zip = &inflater->zip;
+    if(inflater->method == ZIP_STORED)
+    {
+        size_t len = zip->avail_in < READ_BLOCK ? zip->avail_in : READ_BLOCK;
+        memcpy(dest, zip->next_in, len);
+        zip->next_in += len;
+        zip->avail_in -= len;
+        return len;
+    }
+    zip->next_out = (Bytef*)dest;
+    zip->avail_out = READ_BLOCK;
+    while(zip->avail_out > 0 && !inflater->ended)
+    {
+        int retVal = inflate(zip, Z_NO_FLUSH);
+        inflater->ended = retVal == Z_STREAM_END;
+        if(retVal != Z_OK && retVal != Z_STREAM_END)
+        {
+            inflater->failed = true;  // corrupt, or cut before its end.
+            return 0;
+        }
+    }
+    return READ_BLOCK - zip->avail_out;
+}
+
+
+size_t inflaterRead(void *context, char *dest, size_t max)
+{
+    Inflater *inflater = (Inflater*)context;
+    pthread_mutex_lock(&inflater->lock);
+    while(inflater->filled == 0 && !inflater->done)
+    {
+        pthread_cond_wait(&inflater->changed, &inflater->lock);
+    }
+    bool empty = inflater->filled == 0;
+    pthread_mutex_unlock(&inflater->lock);
+    if(empty)
+    {
+        return 0;
+    }
+    size_t left = inflater->lens[inflater->head] - inflater->offset;
+    size_t len = left < max ? left : max;
+    memcpy(dest, inflater->chunks[inflater->head] + inflater->offset, len);
+    inflater->offset += len;
+    if(inflater->offset == inflater->lens[inflater->head])
+    {
+        pthread_mutex_lock(&inflater->lock);
+        inflater->head = (inflater->head + 1) % INFLATE_CHUNKS;
+        inflater->offset = 0;
+        inflater->filled--;
+        pthread_cond_broadcast(&inflater->changed);
+        pthread_mutex_unlock(&inflater->lock);
+    }
+    return len;
+}
+
+
+size_t fileRead(void *context, char *dest, size_t max)
+{
+    return fread(dest, 1, max, (FILE*)context);
+}
+
+
+size_t gzipRead(void *context, char *dest, size_t max)
+{
+    int len = gzread((gzFile)context, dest, (unsigned)max);
+    return len < 0 ? 0 : (size_t)len;
+}
+
+
+unsigned long readLittleEndian(const unsigned char *bytes, int len)
+{
+    unsigned long result = 0;
+    for(int i = len - 1; i >= 0; i--)
+    {
+        result = (result << 8) | bytes[i];
+    }
+    return result;
+}
+
+
+int initWorkspace(Workspace *workspace)
+{
+    if(initCordStore(&workspace->cords, INITIAL_ATOMS) < 0)
+    {
+        return -1;
+    }
+    if(initCordStore(&workspace->frameCords, INITIAL_ATOMS) < 0)
+    {
+        freeCordStore(&workspace->cords);
+        return -1;
+    }
+    return 0;
+}
+
+
+void freeWorkspace(Workspace *workspace)
+{
+    freeCordStore(&workspace->cords);
+    freeCordStore(&workspace->frameCords);
+}
+
+
+int processFilesParallel(char *fileNames[], int filesLen, const Options *options)
+{
+    int threads = options->threads < filesLen ? options->threads : filesLen;
+    FileQueue queue;
+    queue.jobs = (FileJob*)calloc(filesLen, sizeof(FileJob));
+    pthread_t *ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if(queue.jobs == NULL || ids == NULL)
+    {
+        fprintf(stderr, MEM_FAULT_MSG);
+        free(queue.jobs);
+        free(ids);
+        return -1;
+    }
+    for(int i = 0; i < filesLen; i++)
+    {
+        queue.jobs[i].fileName = fileNames[i];
+    }
+    queue.jobsLen = filesLen;
+    queue.next = 0;
+    // threads left over from the file level go to each file's tiled Dmax.
+    queue.options = *options;
+    queue.options.threads = options->threads / threads;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.jobDone, NULL);
+    int started = 0;
+    for(; started < threads; started++)
+    {
+        if(pthread_create(&ids[started], NULL, fileWorker, &queue) != 0)
+        {
+            break;
+        }
+    }
+    if(started == 0)
+    {
+        fileWorker(&queue);  // no threads, analyze everything here.
+    }
+
+    for(int i = 0; i < filesLen; i++)
+    {
+        FileJob *job = &queue.jobs[i];
+        pthread_mutex_lock(&queue.lock);
+        while(!job->done)
+        {
+            pthread_cond_wait(&queue.jobDone, &queue.lock);
+        }
+        pthread_mutex_unlock(&queue.lock);
+        if(job->failed)
+        {
+            fprintf(stderr, MEM_FAULT_MSG);
+        }
+        fwrite(job->err, 1, job->errLen, stderr);
+        fwrite(job->out, 1, job->outLen, stdout);
+        free(job->err);
+        free(job->out);
+    }
+    for(int t = 0; t < started; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    pthread_cond_destroy(&queue.jobDone);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.jobs);
+    free(ids);
+    return 0;
+}
+
+
+void *fileWorker(void *arg)
+{
+    FileQueue *queue = (FileQueue*)arg;
+    Workspace workspace;
+    bool hasWorkspace = initWorkspace(&workspace) == 0;
+    while(true)
+    {
+        pthread_mutex_lock(&queue->lock);
+        int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if(i >= queue->jobsLen)
+        {
+            if(hasWorkspace)
+            {
+                freeWorkspace(&workspace);
+            }
+            return NULL;
+        }
+        FileJob *job = &queue->jobs[i];
+        FILE *out = open_memstream(&job->out, &job->outLen);
+        FILE *err = open_memstream(&job->err, &job->errLen);
+        if(out != NULL && err != NULL && hasWorkspace)
+        {
+            processFile(job->fileName, &queue->options, &workspace, out, err);
+        }
+        else
+        {
+            job->failed = true;  // reported in order with the other files.
+        }
+        if(out != NULL)
+        {
+            fclose(out);
+        }
+        if(err != NULL)
+        {
+            fclose(err);
+        }
+        pthread_mutex_lock(&queue->lock);
+        job->done = true;
+        pthread_cond_broadcast(&queue->jobDone);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+
+int parseOptions(int argc, char *argv[], Options *options)
+{
+    options->dmaxMode = hullDmax;
+    options->kernels = selectKernels(KERNEL_AUTO);
+    options->threads = 1;
+    options->stream = false;
+    options->dmax = true;
+    options->frames = false;
+    options->cache = false;
+    options->contactCutoff = 0;
+    options->binWidth = 0;
+    options->binsLen = 0;
+    options->rmsd = noRmsd;
+    options->serve = false;
+    options->socketPath = NULL;
+    options->benchSizesLen = 0;
+    options->generate = 0;
+    int i = 1;
+    for(; i < argc && strncmp(argv[i], OPTION_PREFIX, strlen(OPTION_PREFIX)) == 0; i++)
+    {
+        const char *value = optionValue(argv[i], DMAX_OPTION);
+        if(value != NULL && strcmp(value, DMAX_HULL) == 0)
+        {
+            options->dmaxMode = hullDmax;
+        }
+        else if(value != NULL && strcmp(value, DMAX_BRUTE) == 0)
+        {
+            options->dmaxMode = bruteDmax;
+        }
+        else if(value != NULL && strcmp(value, DMAX_TILED) == 0)
+        {
+            options->dmaxMode = tiledDmax;
+        }
+        else if((value = optionValue(argv[i], THREADS_OPTION)) != NULL)
+        {
+            if(stringToPositive(value, &options->threads) < 0)
+            {
+                fprintf(stderr, THREADS_ERR_MSG, value);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], STREAM_OPTION) == 0)
+        {
+            options->stream = true;
+        }
+        else if(strcmp(argv[i], NO_DMAX_OPTION) == 0)
+        {
+            options->dmax = false;
+        }
+        else if(strcmp(argv[i], FRAMES_OPTION) == 0)
+        {
+            options->frames = true;
+        }
+        else if(strcmp(argv[i], CACHE_OPTION) == 0)
+        {
+            options->cache = true;
+            mode_t mask = umask(0);  // read before any thread starts, as it is process wide.
+            umask(mask);
+            options->cacheMode = 0666 & ~mask;
+        }
+        else if((value = optionValue(argv[i], CONTACTS_OPTION)) != NULL)
+        {
+            if(stringToDistance(value, &options->contactCutoff, NULL) < 0)
+            {
+                fprintf(stderr, DISTANCE_ERR_MSG, value);
+                return -1;
+            }
+        }
+        else if((value = optionValue(argv[i], RMSD_OPTION)) != NULL &&
+                (strcmp(value, RMSD_TEXT) == 0 || strcmp(value, RMSD_BINARY) == 0))
+        {
+            options->rmsd = strcmp(value, RMSD_TEXT) == 0 ? textRmsd : binaryRmsd;
+        }
+        else if(strcmp(argv[i], SERVE_OPTION) == 0)
+        {
+            options->serve = true;
+        }
+        else if((value = optionValue(argv[i], SOCKET_OPTION)) != NULL && *value != '\0')
+        {
+            options->serve = true;
+            options->socketPath = value;
+        }
+        else if(strcmp(argv[i], BENCH_OPTION) == 0)
+        {
+            const int sizes[] = BENCH_DEFAULT_SIZES;
+            memcpy(options->benchSizes, sizes, sizeof(sizes));
+            options->benchSizesLen = BENCH_DEFAULT_SIZES_LEN;
+        }
+        else if((value = optionValue(argv[i], BENCH_OPTION "=")) != NULL)
+        {
+            if(parseSizes(value, options->benchSizes, &options->benchSizesLen) < 0)
+            {
+                fprintf(stderr, SIZES_ERR_MSG, value);
+                return -1;
+            }
+        }
+        else if((value = optionValue(argv[i], GENERATE_OPTION)) != NULL)
+        {
+            if(stringToPositive(value, &options->generate) < 0 ||
+               options->generate > INT_MAX / BENCH_LINE_LEN)
+            {
+                fprintf(stderr, SIZES_ERR_MSG, value);
+                return -1;
+            }
+        }
+        else if((value = optionValue(argv[i], HISTOGRAM_OPTION)) != NULL)
+        {
+            const char *end;
+            float range;
+            if(stringToDistance(value, &options->binWidth, &end) < 0 ||
+               *end != HISTOGRAM_SEPARATOR || stringToDistance(end + 1, &range, NULL) < 0 ||
+               range / options->binWidth > MAX_BINS)
+            {
+                fprintf(stderr, DISTANCE_ERR_MSG, value);
+                return -1;
+            }
+            options->binsLen = (int)ceilf(range / options->binWidth);
+        }
+        else if((value = optionValue(argv[i], KERNEL_OPTION)) != NULL)
+        {
+            options->kernels = selectKernels(value);
+            if(options->kernels == NULL)
+            {
+                fprintf(stderr, KERNEL_ERR_MSG, value);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, UNKNOWN_OPTION_MSG, argv[i]);
+            return -1;
+        }
+    }
+    return i;
+}
+
+
+int stringToPositive(const char *convertMe, int *dest)
+{
+    char *end;
+    errno = 0;
+    long result = strtol(convertMe, &end, 10);
+    if(errno != 0 || end == convertMe || *end != '\0' || result <= 0 || result > INT_MAX)
+    {
+        return -1;
+    }
+    *dest = (int)result;
+    return 0;
+}
+
+
+int parseSizes(const char *convertMe, int *sizes, int *sizesLen)
+{
+    char *list = strdup(convertMe);
+    int retVal = list == NULL ? -1 : 0;
+    *sizesLen = 0;
+    for(char *size = retVal < 0 ? NULL : strtok(list, SIZES_SEPARATOR); size != NULL;
+        size = strtok(NULL, SIZES_SEPARATOR))
+    {
+        if(*sizesLen == BENCH_MAX_SIZES || stringToPositive(size, &sizes[*sizesLen]) < 0 ||
+           sizes[*sizesLen] > INT_MAX / BENCH_LINE_LEN)
+        {
+            retVal = -1;
+            break;
+        }
+        (*sizesLen)++;
+    }
+    free(list);
+    return *sizesLen > 0 ? retVal : -1;
+}
+
+
+int stringToDistance(const char *convertMe, float *dest, const char **end)
+{
+    char *stop;
+    errno = 0;
+    float result = strtof(convertMe, &stop);
+    if(errno != 0 || stop == convertMe || (end == NULL && *stop != '\0') || !(result > 0) ||
+       isinf(result))
+    {
+        return -1;
+    }
+    if(end != NULL)
+    {
+        *end = stop;
+    }
+    *dest = result;
+    return 0;
+}
+
+
+const char *optionValue(const char *arg, const char *option)
+{
+    if(strncmp(arg, option, strlen(option)) == 0)
+    {
+        return arg + strlen(option);
+    }
+    return NULL;
+}
+
+
+void analyzeProtein(const AtomSource *source, const char* file_name, const Options *options,
+                    Workspace *workspace, FILE *out, FILE *err)
+{
+    if(options->frames)
+    {
+        analyzeFrames(source, file_name, options, workspace, out, err);
+        return;
+    }
+    if(options->cache && source->inflater == NULL &&
+       analyzeCached(source->file, file_name, options, workspace, out, err) == 0)
+    {
+        return;
+    }
+    AtomStream stream;
+    initAtomStream(&stream, options, &workspace->cords);
+    if(readAtoms(source, &stream) < 0 || finishAtomStream(&stream) < 0)
+    {
+        printError(err, stream.error, file_name, stream.badField);
+        return;
+    }
+    if(source->inflater != NULL && source->inflater->failed)
+    {
+        printError(err, inflateError, file_name, NULL);
+        return;
+    }
+    analyzeStream(&stream, file_name, 0, options, out, err);
+}
+
+
+int analyzeBuffer(const char *data, size_t len, const Options *options, Workspace *workspace,
+                  ProteinResult *result)
+{
+    memset(result, 0, sizeof(ProteinResult));
+    AtomStream stream;
+    initAtomStream(&stream, options, &workspace->cords);
+    if(parseAtoms(data, len, true, &stream) < 0 || finishAtomStream(&stream) < 0)
+    {
+        result->error = stream.error == proteinOk ? memoryError : stream.error;
+        memcpy(result->badField, stream.badField, sizeof(result->badField));
+        return -1;
+    }
+    return calcResult(&stream, options, result);
+}
+
+
+void analyzeText(const char *data, size_t len, const char *file_name, const Options *options,
+                 Workspace *workspace, FILE *out, FILE *err)
+{
+    ProteinResult result;
+    if(analyzeBuffer(data, len, options, workspace, &result) < 0)
+    {
+        printError(err, result.error, file_name, result.badField);
+        return;
+    }
+    reportResult(&workspace->cords, file_name, 0, options, &result, out, err);
+}
+
+
+void printError(FILE *err, enum ProteinError error, const char *file_name,
+                const char *badField)
+{
+    if(error == conversionError)
+    {
+        fprintf(err, CONVERSION_ERR_MSG, badField);
+    }
+    else if(error == inflateError)
+    {
+        fprintf(err, INFLATE_ERR_MSG, file_name);
+    }
+    else
+    {
+        fprintf(err, MEM_FAULT_MSG);  // finishAtomStream fails only to allocate.
+    }
+}
+
+
+int analyzeCached(FILE *file, const char *file_name, const Options *options,
+                  Workspace *workspace, FILE *out, FILE *err)
+{
+    struct stat info;
+    int fd = fileno(file);
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        return 1;
+    }
+    CacheHeader header;
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.byteOrder = CACHE_BYTE_ORDER;
+    header.sourceSize = (uint64_t)info.st_size;
+    header.sourceTime = (int64_t)info.st_mtim.tv_sec;
+    header.sourceTimeNsec = (int64_t)info.st_mtim.tv_nsec;
+    char *path = (char*)malloc(strlen(file_name) + strlen(CACHE_SUFFIX) + 1);
+    if(path == NULL)
+    {
+        fprintf(err, MEM_FAULT_MSG);
+        return 0;
+    }
+    strcpy(path, file_name);
+    strcat(path, CACHE_SUFFIX);
+
+    // a cache of the same time is used without reading the pdb file at all.
+    CordStore cached;
+    size_t mapLen;
+    char *data = MAP_FAILED;
+    void *map = mapCache(path, &header, &cached, &mapLen);
+    const CacheHeader *found = (const CacheHeader*)map;
+    if(map == NULL || found->sourceTime != header.sourceTime ||
+       found->sourceTimeNsec != header.sourceTimeNsec)
+    {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            if(map != NULL)
+            {
+                munmap(map, mapLen);
+            }
+            free(path);
+            return 1;
+        }
+        posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+        header.checksum = checksum(data, info.st_size);
+    }
+    if(map != NULL && data != MAP_FAILED)
+    {
+        if(found->checksum == header.checksum)
+        {
+            // touched or copied, record the new time so the next run skips the checksum.
+            header.atoms = found->atoms;
+            writeCache(path, &header, &cached, options->cacheMode);
+        }
+        else
+        {
+            munmap(map, mapLen);
+            map = NULL;
+        }
+    }
+
+    int retVal = 0;
+    if(map != NULL)
+    {
+        retVal = analyzeCords(&cached, file_name, options, workspace, out, err);
+        munmap(map, mapLen);
+    }
+    else
+    {
+        // parse keeping every atom, whatever the options, as the cache needs them all.
+        Options plain = *options;
+        plain.stream = false;
+        plain.dmax = true;
+        AtomStream stream;
+        initAtomStream(&stream, &plain, &workspace->cords);
+        if(parseAtoms(data, info.st_size, true, &stream) < 0)
+        {
+            printError(err, stream.error, file_name, stream.badField);
+        }
+        else
+        {
+            header.atoms = stream.atoms;
+            writeCache(path, &header, &workspace->cords, options->cacheMode);
+            retVal = analyzeCords(&workspace->cords, file_name, options, workspace, out,
+                                  err);
+        }
+    }
+    if(retVal < 0)
+    {
+        fprintf(err, MEM_FAULT_MSG);
+    }
+    free(path);
+    if(data != MAP_FAILED)
+    {
+        munmap(data, info.st_size);
+    }
+    return 0;
+}
+
+
+void *mapCache(const char *path, const CacheHeader *header, CordStore *cords, size_t *mapLen)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(CacheHeader))
+    {
+        map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    const CacheHeader *found = (const CacheHeader*)map;
+    if(memcmp(found->magic, header->magic, sizeof(found->magic)) != 0 ||
+       found->byteOrder != header->byteOrder || found->sourceSize != header->sourceSize ||
+       found->atoms < 0 ||
+       (size_t)info.st_size != sizeof(CacheHeader) + 3 * axisBytes(found->atoms))
+    {
+        munmap(map, info.st_size);
+        return NULL;
+    }
+    char *axes = (char*)map + sizeof(CacheHeader);
+    size_t bytes = axisBytes(found->atoms);
+    cords->x = (float*)axes;
+    cords->y = (float*)(axes + bytes);
+    cords->z = (float*)(axes + 2 * bytes);
+    cords->len = found->atoms;
+    cords->cap = found->atoms;
+    *mapLen = info.st_size;
+    return map;
+}
+
+
+void writeCache(const char *path, const CacheHeader *header, const CordStore *cords,
+                mode_t mode)
+{
+    char *temp = (char*)malloc(strlen(path) + strlen(CACHE_TEMP_SUFFIX) + 1);
+    if(temp == NULL)
+    {
+        return;
+    }
+    strcpy(temp, path);
+    strcat(temp, CACHE_TEMP_SUFFIX);
+    int fd = mkstemp(temp);
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "wb");
+    if(file == NULL)
+    {
+        if(fd >= 0)
+        {
+            close(fd);
+            unlink(temp);
+        }
+        free(temp);
+        return;
+    }
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    size_t bytes = axisBytes(cords->len), used = cords->len * sizeof(float);
+    char padding[CORDS_ALIGNMENT] = {0};
+    bool written = fwrite(header, sizeof(CacheHeader), 1, file) == 1;
+    for(int k = 0; k < 3 && written; k++)
+    {
+        written = fwrite(axes[k], 1, used, file) == used &&
+                  fwrite(padding, 1, bytes - used, file) == bytes - used;
+    }
+    // mkstemp creates the file private to its owner, unlike the files around it.
+    written = written && fchmod(fd, mode) == 0;
+    if(fclose(file) != 0 || !written || rename(temp, path) != 0)
+    {
+        unlink(temp);
+    }
+    free(temp);
+}
+
+
+int analyzeCords(CordStore *all, const char *file_name, const Options *options,
+                 Workspace *workspace, FILE *out, FILE *err)
+{
+    AtomStream stream;
+    if(options->stream)
+    {
+        initAtomStream(&stream, options, &workspace->frameCords);
+        for(int i = 0; i < all->len; i++)
+        {
+            const float cord[3] = {all->x[i], all->y[i], all->z[i]};
+            if(addAtom(&stream, cord) < 0)
+            {
+                return -1;
+            }
+        }
+        if(finishAtomStream(&stream) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        int len = all->len;
+        initAtomStream(&stream, options, all);
+        all->len = len;
+        stream.atoms = len;
+    }
+    analyzeStream(&stream, file_name, 0, options, out, err);
+    return 0;
+}
+
+
+size_t axisBytes(int atoms)
+{
+    return ((size_t)atoms * sizeof(float) + CORDS_ALIGNMENT) & ~(size_t)(CORDS_ALIGNMENT - 1);
+}
+
+
+uint32_t checksum(const char *data, size_t len)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for(size_t done = 0; done < len; done += CHECKSUM_BLOCK)
+    {
+        size_t block = len - done < CHECKSUM_BLOCK ? len - done : CHECKSUM_BLOCK;
+        crc = crc32(crc, (const Bytef*)data + done, (uInt)block);
+    }
+    return (uint32_t)crc;
+}
+
+
+int calcResult(AtomStream *stream, const Options *options, ProteinResult *result)
+{
+    CordStore *cords = stream->cords;
+    const Kernels *kernels = options->kernels;
+    result->atoms = stream->atoms;
+    result->radius = 0;
+    result->dMax = 0;
+    result->hasDmax = options->dmax;
+    if(options->stream)
+    {
+        statsResult(&stream->stats, result->centerMass, &result->radius);
+    }
+    else
+    {
+        calCenterMass(cords, kernels, options->threads, result->centerMass);
+        calcRadius(cords, kernels, options->threads, result->centerMass, &result->radius);
+    }
+    if(!options->dmax)
+    {
+        return 0;
+    }
+    if(options->dmaxMode == bruteDmax)
+    {
+        calcDmax(cords, kernels, &result->dMax);
+    }
+    else if(options->dmaxMode == tiledDmax)
+    {
+        calcDmaxTiled(cords, kernels, options->threads, &result->dMax);
+    }
+    else if(calcDmaxHull(cords, kernels, &result->dMax) < 0)
+    {
+        result->error = memoryError;
+        return -1;
+    }
+    return 0;
+}
+
+
+void analyzeStream(AtomStream *stream, const char *file_name, int model,
+                   const Options *options, FILE *out, FILE *err)
+{
+    ProteinResult result;
+    memset(&result, 0, sizeof(ProteinResult));
+    if(calcResult(stream, options, &result) < 0)
+    {
+        printError(err, result.error, file_name, result.badField);
+        return;
+    }
+    reportResult(stream->cords, file_name, model, options, &result, out, err);
+}
+
+
+void reportResult(const CordStore *cords, const char *file_name, int model,
+                  const Options *options, const ProteinResult *result, FILE *out, FILE *err)
+{
+    report(out, file_name, model, &result->atoms, &result->radius,
+           result->hasDmax ? &result->dMax : NULL, result->centerMass);
+    if(options->contactCutoff > 0 || options->binsLen > 0)
+    {
+        PairCounts counts;
+        counts.cutoffSquared = options->contactCutoff > 0 ?
+                               options->contactCutoff * options->contactCutoff : -1;
+        counts.binWidth = options->binWidth;
+        counts.binsLen = options->binsLen;
+        float range = options->binWidth * options->binsLen;
+        counts.histogramSquared = options->binsLen > 0 ? range * range : -1;
+        counts.contacts = 0;
+        counts.bins = (long*)calloc(options->binsLen > 0 ? options->binsLen : 1, sizeof(long));
+        if(counts.bins == NULL || calcPairs(cords, &counts) < 0)
+        {
+            fprintf(err, MEM_FAULT_MSG);
+        }
+        else
+        {
+            reportPairs(out, options, &counts);
+        }
+        free(counts.bins);
+    }
+}
+
+
+void analyzeFrames(const AtomSource *source, const char* file_name, const Options *options,
+                   Workspace *workspace, FILE *out, FILE *err)
+{
+    FramePipeline frames;
+    frames.cords[0] = &workspace->cords;
+    frames.cords[1] = &workspace->frameCords;
+    for(int k = 0; k < 2; k++)
+    {
+        initAtomStream(&frames.streams[k], options, frames.cords[k]);
+        frames.streams[k].frames = &frames;
+        frames.ready[k] = false;
+    }
+    frames.current = 0;
+    frames.modelsLen = 0;
+    frames.finished = false;
+    frames.fileName = file_name;
+    frames.options = options;
+    frames.out = out;
+    frames.err = err;
+    pthread_mutex_init(&frames.lock, NULL);
+    pthread_cond_init(&frames.changed, NULL);
+    pthread_t analyzer;
+    frames.threaded = pthread_create(&analyzer, NULL, frameAnalyzer, &frames) == 0;
+
+    int retVal = readAtoms(source, &frames.streams[0]);
+    // atoms after the last ENDMDL, or a file without models.
+    if(retVal == 0 && (frames.streams[frames.current].atoms > 0 || frames.modelsLen == 0))
+    {
+        retVal = endFrame(&frames);
+    }
+    pthread_mutex_lock(&frames.lock);
+    frames.finished = true;
+    pthread_cond_broadcast(&frames.changed);
+    pthread_mutex_unlock(&frames.lock);
+    if(frames.threaded)
+    {
+        pthread_join(analyzer, NULL);
+    }
+    if(retVal < 0)
+    {
+        printError(err, frames.streams[0].error, file_name, frames.streams[0].badField);
+    }
+    else if(source->inflater != NULL && source->inflater->failed)
+    {
+        printError(err, inflateError, file_name, NULL);
+    }
+    pthread_cond_destroy(&frames.changed);
+    pthread_mutex_destroy(&frames.lock);
+}
+
+
+int endFrame(FramePipeline *frames)
+{
+    int k = frames->current;
+    AtomStream *stream = &frames->streams[k];
+    if(finishAtomStream(stream) < 0)
+    {
+        return -1;
+    }
+    frames->models[k] = ++frames->modelsLen;
+    if(!frames->threaded)
+    {
+        analyzeStream(stream, frames->fileName, frames->models[k], frames->options, frames->out,
+                      frames->err);
+    }
+    else
+    {
+        pthread_mutex_lock(&frames->lock);
+        frames->ready[k] = true;
+        pthread_cond_broadcast(&frames->changed);
+        while(frames->ready[1 - k])
+        {
+            pthread_cond_wait(&frames->changed, &frames->lock);
+        }
+        pthread_mutex_unlock(&frames->lock);
+        k = 1 - k;
+    }
+    initAtomStream(&frames->streams[k], frames->options, frames->cords[k]);
+    frames->streams[k].frames = frames;
+    frames->current = k;
+    return 0;
+}
+
+
+void *frameAnalyzer(void *arg)
+{
+    FramePipeline *frames = (FramePipeline*)arg;
+    int k = 0;
+    pthread_mutex_lock(&frames->lock);
+    while(true)
+    {
+        while(!frames->ready[k] && !frames->finished)
+        {
+            pthread_cond_wait(&frames->changed, &frames->lock);
+        }
+        if(!frames->ready[k])
+        {
+            break;
+        }
+        pthread_mutex_unlock(&frames->lock);
+        analyzeStream(&frames->streams[k], frames->fileName, frames->models[k],
+                      frames->options, frames->out, frames->err);
+        pthread_mutex_lock(&frames->lock);
+        frames->ready[k] = false;
+        pthread_cond_broadcast(&frames->changed);
+        k = 1 - k;
+    }
+    pthread_mutex_unlock(&frames->lock);
+    return NULL;
+}
+
+
+void report(FILE *out, const char *file_name, int model, const int *atoms,
+            const float *radius, const float *dMax, const float centerMass[])
+{
+    if(model > 0)
+    {
+        fprintf(out, MODEL_STATS_MSG, file_name, model, *atoms);
+    }
+    else
+    {
+        fprintf(out, FILE_STATS_MSG, file_name, *atoms);
+    }
+    fprintf(out, CENTER_MASS_MSG, centerMass[0], centerMass[1], centerMass[2]);
+    fprintf(out, ORB_RADIUS_MSG, *radius);
+    if(dMax != NULL)
+    {
+        fprintf(out, MAX_DISTANCE_MSG, *dMax);
+    }
+}
+
+
+void reportPairs(FILE *out, const Options *options, const PairCounts *counts)
+{
+    if(options->contactCutoff > 0)
+    {
+        fprintf(out, CONTACTS_MSG, options->contactCutoff, counts->contacts);
+    }
+    for(int b = 0; b < options->binsLen; b++)
+    {
+        fprintf(out, HISTOGRAM_MSG, b * options->binWidth, (b + 1) * options->binWidth,
+                counts->bins[b]);
+    }
+}
+
+
+int readAtoms(const AtomSource *source, AtomStream *stream)
+{
+    if(source->inflater != NULL)
+    {
+        return readBlocks(stream, inflaterRead, source->inflater);
+    }
+    struct stat info;
+    int fd = fileno(source->file);
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        char *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED)
+        {
+            posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+            long parsed = parseAtoms(data, info.st_size, true, stream);
+            munmap(data, info.st_size);
+            return parsed < 0 ? -1 : 0;
+        }
+    }
+    return readBlocks(stream, fileRead, source->file);  // not mappable.
+}
+
+
+int readBlocks(AtomStream *stream, size_t (*read)(void *context, char *dest, size_t max),
+               void *context)
+{
+    char buffer[READ_BLOCK];
+    size_t len = 0, got;
+    while((got = read(context, buffer + len, READ_BLOCK - len)) > 0)
+    {
+        len += got;
+        long parsed = parseAtoms(buffer, len, false, stream);
+        if(parsed == 0 && len == READ_BLOCK)
+        {
+            parsed = parseAtoms(buffer, len, true, stream);  // a line longer than a block.
+        }
+        if(parsed < 0)
+        {
+            return -1;
+        }
+        memmove(buffer, buffer + parsed, len - parsed);
+        len -= parsed;
+    }
+    return parseAtoms(buffer, len, true, stream) < 0 ? -1 : 0;
+}
+
+
+long parseAtoms(const char *data, size_t len, bool final, AtomStream *stream)
+{
+    AtomStream *root = stream;
+    FramePipeline *frames = stream->frames;
+    if(frames != NULL)
+    {
+        stream = &frames->streams[frames->current];
+    }
+    const char *line = data, *end = data + len;
+    while(line < end)
+    {
+        const char *next = (const char*)memchr(line, '\n', end - line);
+        if(next == NULL && !final)
+        {
+            break;
+        }
+        const char *lineEnd = next == NULL ? end : next;
+        if(lineEnd - line >= RECORD_LEN && memcmp(line, ATOM, RECORD_LEN) == 0)
+        {
+            float cord[3];
+            if(extractCords(line, lineEnd - line, cord, root->badField) < 0)
+            {
+                root->error = conversionError;
+                return -1;
+            }
+            if(addAtom(stream, cord) < 0)
+            {
+                root->error = memoryError;
+                return -1;
+            }
+        }
+        else if(frames != NULL && ((lineEnd - line >= (long)strlen(END_MODEL) &&
+                                    memcmp(line, END_MODEL, strlen(END_MODEL)) == 0) ||
+                                   (lineEnd - line >= (long)strlen(MODEL) &&
+                                    memcmp(line, MODEL, strlen(MODEL)) == 0 && stream->atoms > 0)))
+        {
+            // ENDMDL closes a frame. so does MODEL, for files missing their ENDMDL.
+            if(endFrame(frames) < 0)
+            {
+                root->error = memoryError;
+                return -1;
+            }
+            stream = &frames->streams[frames->current];
+        }
+        line = next == NULL ? end : next + 1;
+    }
+    return line - data;
+}
+
+
+void initAtomStream(AtomStream *stream, const Options *options, CordStore *cords)
+{
+    memset(stream, 0, sizeof(AtomStream));
+    stream->frames = NULL;
+    // pair counts need every atom, so they keep them all like Dmax does without filtering.
+    bool pairs = options->contactCutoff > 0 || options->binsLen > 0;
+    stream->cords = options->stream && !options->dmax && !pairs ? NULL : cords;
+    stream->streamStats = options->stream;
+    stream->filter = options->stream && options->dmax && options->dmaxMode == hullDmax && !pairs;
+    if(stream->cords != NULL)
+    {
+        stream->cords->len = 0;
+    }
+}
+
+
+int addAtom(AtomStream *stream, const float cord[3])
+{
+    stream->atoms++;
+    if(stream->streamStats)
+    {
+        updateStats(&stream->stats, cord);
+    }
+    if(stream->cords == NULL)
+    {
+        return 0;
+    }
+    if(pushCord(stream->cords, cord) < 0)
+    {
+        return -1;
+    }
+    if(stream->filter && stream->cords->len - stream->blockStart >= STREAM_BLOCK)
+    {
+        return filterBlock(stream);
+    }
+    return 0;
+}
+
+
+int finishAtomStream(AtomStream *stream)
+{
+    if(stream->filter && stream->cords->len > stream->blockStart)
+    {
+        return filterBlock(stream);
+    }
+    return 0;
+}
+
+
+int filterBlock(AtomStream *stream)
+{
+    CordStore *cords = stream->cords;
+    double directions[EXTREME_DIRECTIONS][3];
+    for(int e = 0; e < EXTREME_DIRECTIONS; e++)
+    {
+        extremeDirection(e, directions[e]);
+    }
+    for(int i = stream->blockStart; i < cords->len; i++)
+    {
+        const float cord[3] = {cords->x[i], cords->y[i], cords->z[i]};
+        for(int e = 0; e < EXTREME_DIRECTIONS; e++)
+        {
+            const double *d = directions[e];
+            const float *x = stream->extremes[e];
+            double along = d[0] * cord[0] + d[1] * cord[1] + d[2] * cord[2];
+            if(!stream->hasExtremes || along > d[0] * x[0] + d[1] * x[1] + d[2] * x[2])
+            {
+                memcpy(stream->extremes[e], cord, sizeof(cord));
+            }
+        }
+        stream->hasExtremes = true;
+    }
+
+    double points[EXTREME_DIRECTIONS * 3];
+    for(int e = 0; e < EXTREME_DIRECTIONS; e++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            points[3 * e + k] = stream->extremes[e][k];
+        }
+    }
+    Hull hull;
+    int retVal = initHull(&hull, points, EXTREME_DIRECTIONS);
+    for(int e = 0; e < EXTREME_DIRECTIONS && retVal == 0; e++)
+    {
+        retVal = hullInsert(&hull, e);
+    }
+    if(retVal == 0)
+    {
+        // refilter all kept atoms once they doubled, as the polytope only grows.
+        int from = cords->len > 2 * stream->filteredLen ? 0 : stream->blockStart;
+        int kept = from;
+        for(int i = from; i < cords->len; i++)
+        {
+            const double cord[3] = {cords->x[i], cords->y[i], cords->z[i]};
+            bool inside = true;
+            for(int f = 0; f < hull.facesLen && inside; f++)
+            {
+                inside = !hull.faces[f].alive || planeDistance(&hull.faces[f], cord) < -hull.eps;
+            }
+            if(!inside)
+            {
+                cords->x[kept] = cords->x[i];
+                cords->y[kept] = cords->y[i];
+                cords->z[kept] = cords->z[i];
+                kept++;
+            }
+        }
+        cords->len = kept;
+        stream->filteredLen = from == 0 ? kept : stream->filteredLen;
+    }
+    freeHull(&hull);
+    stream->blockStart = cords->len;
+    return retVal < 0 ? -1 : 0;  // flat extremes filter nothing.
+}
+
+
+void updateStats(AtomStats *stats, const float cord[3])
+{
+    stats->count++;
+    for(int k = 0; k < 3; k++)
+    {
+        double delta = cord[k] - stats->mean[k];
+        stats->mean[k] += delta / stats->count;
+        stats->squares[k] += delta * (cord[k] - stats->mean[k]);
+    }
+}
+
+
+void statsResult(const AtomStats *stats, float *centerMass, float *radius)
+{
+    for(int k = 0; k < 3; k++)
+    {
+        // no atoms gives nan, like dividing the sums.
+        centerMass[k] = (float)(stats->count > 0 ? stats->mean[k] : 0.0 / stats->count);
+    }
+    *radius = (float)sqrt((stats->squares[0] + stats->squares[1] + stats->squares[2]) /
+                          stats->count);
+}
+
+
+int extractCords(const char *line, size_t lineLen, float cords[3], char *badField)
+{
+    for(int k = 0; k < 3; k++)
+    {
+        size_t start = X_COLUMN + k * CORD_WIDTH;
+        int len = lineLen <= start ? 0 : (lineLen - start < CORD_WIDTH ? (int)(lineLen - start)
+                                                                         : CORD_WIDTH);
+        if(decodeCord(line + start, len, &cords[k]) < 0)
+        {
+            char field[CORD_WIDTH + 1] = "";
+            memcpy(field, line + start, len);
+            if(stringToFloat(field, &cords[k]) < 0)
+            {
+                memcpy(badField, field, sizeof(field));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+int decodeCord(const char *field, int len, float *dest)
+{
+    static const float powers[MAX_CORD_DIGITS + 1] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                                      1e6f, 1e7f};
+    int i = 0;
+    while(i < len && field[i] == ' ')
+    {
+        i++;
+    }
+    bool negative = i < len && field[i] == '-';
+    i += negative;
+    long value = 0;
+    int digits = 0, decimals = -1;
+    for(; i < len && field[i] != ' '; i++)
+    {
+        if(field[i] == '.' && decimals < 0)
+        {
+            decimals = 0;
+            continue;
+        }
+        if(field[i] < '0' || field[i] > '9')
+        {
+            return -1;
+        }
+        value = value * 10 + (field[i] - '0');
+        digits++;
+        decimals += decimals >= 0;
+    }
+    // at most 7 digits is exact in a float, so one division rounds like strtof.
+    if(digits == 0 || digits > MAX_CORD_DIGITS || i < len)
+    {
+        return -1;
+    }
+    float result = (float)value / powers[decimals < 0 ? 0 : decimals];
+    *dest = negative ? -result : result;
+    return 0;
+}
+
+
+int stringToFloat(const char convertMe[], float* dest)
+{
+    char *end;
+    float result = 0;
+    errno = 0;
+    result = strtof(convertMe, &end);
+    if(result == 0 && (errno != 0 || end == convertMe))
+    {
+        return -1;
+    }
+    *dest = result;
+    return 0;
+}
+
+
+void calcDmax(const CordStore *cords, const Kernels *kernels, float *dMax)
+{
+    float maxSquared = 0;
+    for(int i = 1; i < cords->len; i++)
+    {
+        const float p[3] = {cords->x[i], cords->y[i], cords->z[i]};
+        float sol = kernels->maxDistance(cords, 0, i, p);
+        if (maxSquared < sol)
+        {
+            maxSquared = sol;
+        }
+    }
+    *dMax = sqrtf(maxSquared);
+}
+
+
+int calcDmaxHull(const CordStore *cords, const Kernels *kernels, float *dMax)
+{
+    double *points = (double*)malloc(cords->len * 3 * sizeof(double));
+    int *vertices = (int*)malloc(cords->len * sizeof(int));
+    if((points == NULL || vertices == NULL) && cords->len > 0)
+    {
+        free(points);
+        free(vertices);
+        return -1;
+    }
+    for(int i = 0; i < cords->len; i++)
+    {
+        points[3 * i] = cords->x[i];
+        points[3 * i + 1] = cords->y[i];
+        points[3 * i + 2] = cords->z[i];
+    }
+    int verticesLen = 0;
+    int retVal = hullVertices(points, cords->len, vertices, &verticesLen);
+    free(points);
+    if(retVal > 0)
+    {
+        free(vertices);
+        calcDmax(cords, kernels, dMax);
+        return 0;
+    }
+    CordStore hullCords;
+    if(retVal < 0 || initCordStore(&hullCords, verticesLen) < 0)
+    {
+        free(vertices);
+        return -1;
+    }
+    for(int i = 0; i < verticesLen; i++)
+    {
+        const float cord[3] = {cords->x[vertices[i]], cords->y[vertices[i]],
+                               cords->z[vertices[i]]};
+        pushCord(&hullCords, cord);
+    }
+    free(vertices);
+    calcDmax(&hullCords, kernels, dMax);
+    freeCordStore(&hullCords);
+    return 0;
+}
+
+
+void calcDmaxTiled(const CordStore *cords, const Kernels *kernels, int threads, float *dMax)
+{
+    long tilesPerSide = (cords->len + TILE_ATOMS - 1) / TILE_ATOMS;
+    TileQueue queue = {cords, kernels, tilesPerSide * (tilesPerSide + 1) / 2, 0,
+                       PTHREAD_MUTEX_INITIALIZER};
+    TileWorker *workers = (TileWorker*)malloc(threads * sizeof(TileWorker));
+    pthread_t *ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if(workers == NULL || ids == NULL)
+    {
+        threads = 1;  // the calling thread alone.
+    }
+    TileWorker self = {&queue, 0};
+    int started = 1;
+    for(; started < threads; started++)
+    {
+        workers[started].queue = &queue;
+        workers[started].maxSquared = 0;
+        if(pthread_create(&ids[started], NULL, tileWorker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+    tileWorker(&self);
+    float maxSquared = self.maxSquared;
+    for(int t = 1; t < started; t++)
+    {
+        pthread_join(ids[t], NULL);
+        maxSquared = workers[t].maxSquared > maxSquared ? workers[t].maxSquared : maxSquared;
+    }
+    free(workers);
+    free(ids);
+    pthread_mutex_destroy(&queue.lock);
+    *dMax = sqrtf(maxSquared);
+}
+
+
+void *tileWorker(void *arg)
+{
+    TileWorker *worker = (TileWorker*)arg;
+    TileQueue *queue = worker->queue;
+    while(true)
+    {
+        pthread_mutex_lock(&queue->lock);
+        long tile = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if(tile >= queue->tilesLen)
+        {
+            return NULL;
+        }
+        float sol = tileMax(queue, tile);
+        if(worker->maxSquared < sol)
+        {
+            worker->maxSquared = sol;
+        }
+    }
+}
+
+
+float tileMax(const TileQueue *queue, long tile)
+{
+    long row, col;
+    triangleCell(tile, &row, &col);
+    const CordStore *cords = queue->cords;
+    int rowStart = (int)(row * TILE_ATOMS);
+    int rowEnd = rowStart + TILE_ATOMS < cords->len ? rowStart + TILE_ATOMS : cords->len;
+    int colStart = (int)(col * TILE_ATOMS);
+    float best = 0;
+    for(int i = rowStart; i < rowEnd; i++)
+    {
+        const float p[3] = {cords->x[i], cords->y[i], cords->z[i]};
+        // on the diagonal only the pairs below i, like calcDmax.
+        int colEnd = row == col ? i : colStart + TILE_ATOMS;
+        float sol = queue->kernels->maxDistance(cords, colStart, colEnd, p);
+        best = sol > best ? sol : best;
+    }
+    return best;
+}
+
+
+void triangleCell(long index, long *row, long *col)
+{
+    long r = (long)((sqrt(8.0 * index + 1) - 1) / 2);
+    while(r * (r + 1) / 2 > index)
+    {
+        r--;
+    }
+    while((r + 1) * (r + 2) / 2 <= index)
+    {
+        r++;
+    }
+    *row = r;
+    *col = index - r * (r + 1) / 2;
+}
+
+
+int rmsdMatrix(char *fileNames[], int filesLen, const Options *options)
+{
+    CordStore *structures = (CordStore*)calloc(filesLen, sizeof(CordStore));
+    double *norms = (double*)malloc(filesLen * sizeof(double));
+    double *matrix = (double*)calloc((size_t)filesLen * filesLen, sizeof(double));
+    int loaded = 0, retVal = structures == NULL || norms == NULL || matrix == NULL ? -1 : 0;
+    if(retVal < 0)
+    {
+        fprintf(stderr, MEM_FAULT_MSG);
+    }
+    for(; loaded < filesLen && retVal == 0; loaded++)
+    {
+        CordStore *cords = &structures[loaded];
+        if(initCordStore(cords, INITIAL_ATOMS) < 0)
+        {
+            fprintf(stderr, MEM_FAULT_MSG);
+            retVal = -1;
+            break;
+        }
+        retVal = loadStructure(fileNames[loaded], options, cords);
+        if(retVal == 0 && cords->len != structures[0].len)
+        {
+            fprintf(stderr, RMSD_ATOMS_ERR_MSG, fileNames[loaded], cords->len, fileNames[0],
+                    structures[0].len);
+            retVal = -1;
+        }
+        if(retVal < 0)
+        {
+            loaded++;  // free it too.
+            break;
+        }
+        // center on the center of mass, so only the rotation is left to find.
+        float centerMass[3];
+        calCenterMass(cords, options->kernels, 1, centerMass);  // files are split over threads.
+        for(int i = 0; i < cords->len; i++)
+        {
+            cords->x[i] -= centerMass[0];
+            cords->y[i] -= centerMass[1];
+            cords->z[i] -= centerMass[2];
+        }
+        const double origin[3] = {0, 0, 0};
+        double sums[3];
+        options->kernels->squares(cords, origin, sums);
+        norms[loaded] = sums[0] + sums[1] + sums[2];
+    }
+
+    if(retVal == 0)
+    {
+        RmsdQueue queue = {structures, norms, options->kernels, filesLen,
+                           (long)filesLen * (filesLen - 1) / 2, 0, matrix,
+                           PTHREAD_MUTEX_INITIALIZER};
+        int threads = options->threads;
+        pthread_t *ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+        int started = 1;
+        for(; ids != NULL && started < threads; started++)
+        {
+            if(pthread_create(&ids[started], NULL, rmsdWorker, &queue) != 0)
+            {
+                break;
+            }
+        }
+        rmsdWorker(&queue);
+        for(int t = 1; t < started; t++)
+        {
+            pthread_join(ids[t], NULL);
+        }
+        free(ids);
+        pthread_mutex_destroy(&queue.lock);
+
+        if(options->rmsd == binaryRmsd)
+        {
+            int32_t len = filesLen;
+            fwrite(&len, sizeof(int32_t), 1, stdout);
+            fwrite(matrix, sizeof(double), (size_t)filesLen * filesLen, stdout);
+        }
+        else
+        {
+            for(int i = 0; i < filesLen; i++)
+            {
+                for(int j = 0; j < filesLen; j++)
+                {
+                    if(j > 0)
+                    {
+                        putchar(RMSD_SEPARATOR);
+                    }
+                    printf(RMSD_MSG, matrix[(size_t)i * filesLen + j]);
+                }
+                putchar('\n');
+            }
+        }
+    }
+    for(int i = 0; structures != NULL && i < loaded; i++)
+    {
+        freeCordStore(&structures[i]);
+    }
+    free(structures);
+    free(norms);
+    free(matrix);
+    return retVal;
+}
+
+
+int loadStructure(const char *file_name, const Options *options, CordStore *cords)
+{
+    FILE *file = fopen(file_name, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, FILE_NOT_FOUND_MSG, file_name);
+        return -1;
+    }
+    enum FileFormat format = sniffFormat(file);
+    if(format == zipFormat)
+    {
+        fclose(file);
+        fprintf(stderr, RMSD_ARCHIVE_ERR_MSG, file_name);
+        return -1;
+    }
+    Options plain = *options;
+    plain.stream = false;
+    AtomStream stream;
+    initAtomStream(&stream, &plain, cords);
+    int retVal;
+    if(format == gzipFormat)
+    {
+        // structures are loaded one at a time, so no Inflater thread would overlap.
+        int fd = dup(fileno(file));
+        gzFile gz = fd < 0 ? NULL : gzdopen(fd, "rb");
+        if(gz == NULL)
+        {
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+            fclose(file);
+            fprintf(stderr, MEM_FAULT_MSG);
+            return -1;
+        }
+        retVal = readBlocks(&stream, gzipRead, gz);
+        int gzError;
+        gzerror(gz, &gzError);
+        if(retVal == 0 && gzError != Z_OK)
+        {
+            stream.error = inflateError;  // corrupt, or cut before its end.
+            retVal = -1;
+        }
+        gzclose(gz);
+    }
+    else
+    {
+        AtomSource source = {file, NULL};
+        retVal = readAtoms(&source, &stream);
+    }
+    fclose(file);
+    if(retVal < 0)
+    {
+        printError(stderr, stream.error, file_name, stream.badField);
+    }
+    return retVal;
+}
+
+
+void *rmsdWorker(void *arg)
+{
+    RmsdQueue *queue = (RmsdQueue*)arg;
+    while(true)
+    {
+        pthread_mutex_lock(&queue->lock);
+        long pair = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if(pair >= queue->pairsLen)
+        {
+            return NULL;
+        }
+        // pairs are the lower triangle without the diagonal.
+        long row, col;
+        triangleCell(pair, &row, &col);
+        row++;
+        double cov[9];
+        queue->kernels->covariance(&queue->structures[row], &queue->structures[col], cov);
+        double rmsd = qcpRmsd(cov, queue->norms[row] + queue->norms[col],
+                              queue->structures[row].len);
+        queue->matrix[row * queue->structuresLen + col] = rmsd;
+        queue->matrix[col * queue->structuresLen + row] = rmsd;
+    }
+}
+
+
+double qcpRmsd(const double cov[9], double norms, int atoms)
+{
+    if(atoms == 0)
+    {
+        return 0;
+    }
+    double sxx = cov[0], sxy = cov[1], sxz = cov[2];
+    double syx = cov[3], syy = cov[4], syz = cov[5];
+    double szx = cov[6], szy = cov[7], szz = cov[8];
+    double sxx2 = sxx * sxx, syy2 = syy * syy, szz2 = szz * szz;
+    double sxy2 = sxy * sxy, syz2 = syz * syz, sxz2 = sxz * sxz;
+    double syx2 = syx * syx, szy2 = szy * szy, szx2 = szx * szx;
+
+    // coefficients of the characteristic polynomial x^4 + c2 x^2 + c1 x + c0 of the key matrix.
+    double syzSzyMinusSyySzz2 = 2.0 * (syz * szy - syy * szz);
+    double sxx2Syy2Szz2Syz2Szy2 = syy2 + szz2 - sxx2 + syz2 + szy2;
+    double c2 = -2.0 * (sxx2 + syy2 + szz2 + sxy2 + syx2 + sxz2 + szx2 + syz2 + szy2);
+    double c1 = 8.0 * (sxx * syz * szy + syy * szx * sxz + szz * sxy * syx -
+                       sxx * syy * szz - syz * szx * sxy - szy * syx * sxz);
+    double sxzPlusSzx = sxz + szx, syzPlusSzy = syz + szy, sxyPlusSyx = sxy + syx;
+    double syzMinusSzy = syz - szy, sxzMinusSzx = sxz - szx, sxyMinusSyx = sxy - syx;
+    double sxxPlusSyy = sxx + syy, sxxMinusSyy = sxx - syy;
+    double sxy2Sxz2Syx2Szx2 = sxy2 + sxz2 - syx2 - szx2;
+    double c0 = sxy2Sxz2Syx2Szx2 * sxy2Sxz2Syx2Szx2 +
+                (sxx2Syy2Szz2Syz2Szy2 + syzSzyMinusSyySzz2) *
+                (sxx2Syy2Szz2Syz2Szy2 - syzSzyMinusSyySzz2) +
+                (-sxzPlusSzx * syzMinusSzy + sxyMinusSyx * (sxxMinusSyy - szz)) *
+                (-sxzMinusSzx * syzPlusSzy + sxyMinusSyx * (sxxMinusSyy + szz)) +
+                (-sxzPlusSzx * syzPlusSzy - sxyPlusSyx * (sxxPlusSyy - szz)) *
+                (-sxzMinusSzx * syzMinusSzy - sxyPlusSyx * (sxxPlusSyy + szz)) +
+                (sxyPlusSyx * syzPlusSzy + sxzPlusSzx * (sxxMinusSyy + szz)) *
+                (-sxyMinusSyx * syzMinusSzy + sxzPlusSzx * (sxxPlusSyy + szz)) +
+                (sxyPlusSyx * syzMinusSzy + sxzMinusSzx * (sxxMinusSyy - szz)) *
+                (-sxyMinusSyx * syzPlusSzy + sxzMinusSzx * (sxxPlusSyy - szz));
+
+    // newton from an upper bound of the largest eigenvalue converges to it.
+    double half = norms / 2.0, eigen = half;
+    for(int i = 0; i < QCP_ITERATIONS; i++)
+    {
+        double old = eigen, eigen2 = eigen * eigen;
+        double b = (eigen2 + c2) * eigen;
+        double a = b + c1;
+        eigen -= (a * eigen + c0) / (2.0 * eigen2 * eigen + b + a);
+        if(fabs(eigen - old) < fabs(QCP_PRECISION * eigen))
+        {
+            break;
+        }
+    }
+    return sqrt(fabs(2.0 * (half - eigen) / atoms));
+}
+
+
+int calcPairs(const CordStore *cords, PairCounts *counts)
+{
+    if(cords->len < 2)
+    {
+        return 0;
+    }
+    float range = sqrtf(counts->cutoffSquared > counts->histogramSquared ?
+                        counts->cutoffSquared : counts->histogramSquared);
+    CellList cells;
+    if(initCellList(&cells, cords, range) < 0)
+    {
+        freeCellList(&cells);
+        return -1;
+    }
+    // visit each pair of adjacent cells once: the cell itself, then half of its neighbours.
+    int shell[HALF_SHELL][3], shellLen = 0;
+    for(int dz = -1; dz <= 1; dz++)
+    {
+        for(int dy = -1; dy <= 1; dy++)
+        {
+            for(int dx = -1; dx <= 1; dx++)
+            {
+                if(dz > 0 || (dz == 0 && (dy > 0 || (dy == 0 && dx > 0))))
+                {
+                    shell[shellLen][0] = dx;
+                    shell[shellLen][1] = dy;
+                    shell[shellLen][2] = dz;
+                    shellLen++;
+                }
+            }
+        }
+    }
+    const int *dims = cells.dims;
+    for(int cz = 0; cz < dims[2]; cz++)
+    {
+        for(int cy = 0; cy < dims[1]; cy++)
+        {
+            for(int cx = 0; cx < dims[0]; cx++)
+            {
+                int cell = (cz * dims[1] + cy) * dims[0] + cx;
+                countCellPairs(&cells, cell, cell, counts);
+                for(int n = 0; n < HALF_SHELL; n++)
+                {
+                    int x = cx + shell[n][0], y = cy + shell[n][1], z = cz + shell[n][2];
+                    if(x >= 0 && x < dims[0] && y >= 0 && y < dims[1] && z < dims[2])
+                    {
+                        countCellPairs(&cells, cell, (z * dims[1] + y) * dims[0] + x, counts);
+                    }
+                }
+            }
+        }
+    }
+    freeCellList(&cells);
+    return 0;
+}
+
+
+int initCellList(CellList *cells, const CordStore *cords, float range)
+{
+    memset(cells, 0, sizeof(CellList));
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    float high[3];
+    for(int k = 0; k < 3; k++)
+    {
+        cells->origin[k] = high[k] = axes[k][0];
+        for(int i = 1; i < cords->len; i++)
+        {
+            cells->origin[k] = axes[k][i] < cells->origin[k] ? axes[k][i] : cells->origin[k];
+            high[k] = axes[k][i] > high[k] ? axes[k][i] : high[k];
+        }
+    }
+    // more cells than atoms only adds empty cells to visit, so sparse grids get wider cells.
+    double size = range, cellsLen;
+    do
+    {
+        cellsLen = 1;
+        for(int k = 0; k < 3; k++)
+        {
+            cellsLen *= floor((high[k] - cells->origin[k]) / size) + 1;
+        }
+        size = cellsLen > cords->len ? size * CELL_GROWTH : size;
+    } while(cellsLen > cords->len);
+    cells->size = (float)size;
+    for(int k = 0; k < 3; k++)
+    {
+        cells->dims[k] = (int)floor((high[k] - cells->origin[k]) / size) + 1;
+    }
+    int *cellOf = (int*)malloc(cords->len * sizeof(int));
+    cells->cellStart = (int*)calloc((size_t)cellsLen + 1, sizeof(int));
+    cells->x = (float*)malloc(cords->len * sizeof(float));
+    cells->y = (float*)malloc(cords->len * sizeof(float));
+    cells->z = (float*)malloc(cords->len * sizeof(float));
+    if(cellOf == NULL || cells->cellStart == NULL || cells->x == NULL || cells->y == NULL ||
+       cells->z == NULL)
+    {
+        free(cellOf);
+        return -1;
+    }
+    // counting sort by cell, so the atoms of a cell are contiguous.
+    for(int i = 0; i < cords->len; i++)
+    {
+        int cell = 0;
+        for(int k = 2; k >= 0; k--)
+        {
+            int c = (int)((axes[k][i] - cells->origin[k]) / cells->size);
+            c = c < cells->dims[k] ? c : cells->dims[k] - 1;  // rounding at the high edge.
+            cell = cell * cells->dims[k] + c;
+        }
+        cellOf[i] = cell;
+        cells->cellStart[cell + 1]++;
+    }
+    for(long c = 0; c < (long)cellsLen; c++)
+    {
+        cells->cellStart[c + 1] += cells->cellStart[c];
+    }
+    for(int i = 0; i < cords->len; i++)
+    {
+        int at = cells->cellStart[cellOf[i]]++;
+        cells->x[at] = cords->x[i];
+        cells->y[at] = cords->y[i];
+        cells->z[at] = cords->z[i];
+    }
+    // filling moved each start to the next cell's start.
+    memmove(cells->cellStart + 1, cells->cellStart, (size_t)cellsLen * sizeof(int));
+    cells->cellStart[0] = 0;
+    free(cellOf);
+    return 0;
+}
+
+
+void countCellPairs(const CellList *cells, int a, int b, PairCounts *counts)
+{
+    for(int i = cells->cellStart[a]; i < cells->cellStart[a + 1]; i++)
+    {
+        for(int j = a == b ? i + 1 : cells->cellStart[b]; j < cells->cellStart[b + 1]; j++)
+        {
+            float xDiff = cells->x[i] - cells->x[j];
+            float yDiff = cells->y[i] - cells->y[j];
+            float zDiff = cells->z[i] - cells->z[j];
+            float squared = xDiff * xDiff + yDiff * yDiff + zDiff * zDiff;
+            counts->contacts += squared <= counts->cutoffSquared;
+            if(squared < counts->histogramSquared)
+            {
+                int bin = (int)(sqrtf(squared) / counts->binWidth);
+                counts->bins[bin < counts->binsLen ? bin : counts->binsLen - 1]++;
+            }
+        }
+    }
+}
+
+
+void freeCellList(CellList *cells)
+{
+    free(cells->cellStart);
+    free(cells->x);
+    free(cells->y);
+    free(cells->z);
+    cells->cellStart = NULL;
+    cells->x = NULL;
+    cells->y = NULL;
+    cells->z = NULL;
+}
+
+
+int initHull(Hull *hull, const double *points, int pointsLen)
+{
+    hull->faces = NULL;
+    hull->freeFaces = NULL;
+    hull->visible = NULL;
+    hull->horizon = NULL;
+    hull->startAt = NULL;
+    hull->endAt = NULL;
+    if(pointsLen < 4)
+    {
+        return 1;
+    }
+    const double *p = points;
+    double scale = 0;
+    int first = 0;
+    for(int i = 0; i < pointsLen; i++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            scale = fmax(scale, fabs(p[3 * i + k]));
+        }
+        first = p[3 * i] < p[3 * first] ? i : first;
+    }
+    double eps = HULL_EPS * (scale + 1);
+
+    // initial tetrahedron: farthest point, then farthest from the line, then from the plane.
+    int simplex[4] = {first, first, first, first};
+    double best = 0;
+    for(int i = 0; i < pointsLen; i++)
+    {
+        double d[3] = {p[3 * i] - p[3 * first], p[3 * i + 1] - p[3 * first + 1],
+                       p[3 * i + 2] - p[3 * first + 2]};
+        double dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        if(dist > best)
+        {
+            best = dist;
+            simplex[1] = i;
+        }
+    }
+    const double *a = p + 3 * simplex[0], *b = p + 3 * simplex[1];
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double normal[3] = {0, 0, 0};
+    best = 0;
+    for(int i = 0; i < pointsLen; i++)
+    {
+        const double *c = p + 3 * i;
+        double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        double cross[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2],
+                           ab[0] * ac[1] - ab[1] * ac[0]};
+        double area = cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2];
+        if(area > best)
+        {
+            best = area;
+            simplex[2] = i;
+            memcpy(normal, cross, sizeof(normal));
+        }
+    }
+    best = 0;
+    for(int i = 0; i < pointsLen; i++)
+    {
+        const double *c = p + 3 * i;
+        double vol = fabs(normal[0] * (c[0] - a[0]) + normal[1] * (c[1] - a[1]) +
+                          normal[2] * (c[2] - a[2]));
+        if(vol > best)
+        {
+            best = vol;
+            simplex[3] = i;
+        }
+    }
+    // the heights of the triangle and of the tetrahedron, against the diameter.
+    double diameter = sqrt(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2]);
+    double normalLen = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    double flat = fmax(HULL_FLAT * diameter, eps);
+    if(diameter <= eps || normalLen / diameter <= flat || best / normalLen <= flat)
+    {
+        return 1;
+    }
+
+    hull->points = points;
+    hull->eps = eps;
+    hull->facesLen = 0;
+    hull->facesCap = 64;
+    hull->freeLen = 0;
+    hull->faces = (HullFace*)malloc(hull->facesCap * sizeof(HullFace));
+    hull->freeFaces = (int*)malloc(hull->facesCap * sizeof(int));
+    hull->visible = (int*)malloc(hull->facesCap * sizeof(int));
+    hull->horizonCap = hull->facesCap;
+    hull->horizon = (int*)malloc(3 * hull->horizonCap * sizeof(int));
+    hull->startAt = (int*)malloc(pointsLen * sizeof(int));
+    hull->endAt = (int*)malloc(pointsLen * sizeof(int));
+    if(hull->faces == NULL || hull->freeFaces == NULL || hull->visible == NULL ||
+       hull->horizon == NULL || hull->startAt == NULL || hull->endAt == NULL)
+    {
+        return -1;
+    }
+
+    // orient the simplex faces outwards and link the edges between them.
+    const int sides[4][3] = {{0, 1, 2}, {0, 3, 1}, {1, 3, 2}, {0, 2, 3}};
+    for(int f = 0; f < 4; f++)
+    {
+        hullAddFace(hull, simplex[sides[f][0]], simplex[sides[f][1]], simplex[sides[f][2]]);
+    }
+    if(faceDistance(hull, &hull->faces[0], simplex[3]) > 0)
+    {
+        for(int f = 0; f < 4; f++)
+        {
+            HullFace *face = &hull->faces[f];
+            int tmp = face->v[1];
+            face->v[1] = face->v[2];
+            face->v[2] = tmp;
+            for(int k = 0; k < 3; k++)
+            {
+                face->normal[k] = -face->normal[k];
+            }
+            face->offset = -face->offset;
+        }
+    }
+    for(int f = 0; f < 4; f++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            int from = hull->faces[f].v[k], to = hull->faces[f].v[(k + 1) % 3];
+            for(int g = 0; g < 4; g++)
+            {
+                for(int m = 0; m < 3; m++)
+                {
+                    if(hull->faces[g].v[m] == to && hull->faces[g].v[(m + 1) % 3] == from)
+                    {
+                        hull->faces[f].adj[k] = g;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+
+int hullVertices(const double *points, int pointsLen, int *vertices, int *verticesLen)
+{
+    *verticesLen = 0;
+    Hull hull;
+    int retVal = initHull(&hull, points, pointsLen);
+    if(retVal != 0)
+    {
+        freeHull(&hull);
+        return retVal;
+    }
+    const double *p = points;
+    double eps = hull.eps;
+
+    // points extreme along a few directions make a polytope that hides most of the atoms.
+    for(int e = 0; e < EXTREME_DIRECTIONS && retVal == 0; e++)
+    {
+        double d[3];
+        extremeDirection(e, d);
+        int extreme = 0;
+        for(int i = 1; i < pointsLen; i++)
+        {
+            const double *c = p + 3 * i, *x = p + 3 * extreme;
+            if(d[0] * c[0] + d[1] * c[1] + d[2] * c[2] > d[0] * x[0] + d[1] * x[1] + d[2] * x[2])
+            {
+                extreme = i;
+            }
+        }
+        retVal = hullInsert(&hull, extreme);
+    }
+    int filterLen = 0;
+    HullFace *filter = (HullFace*)malloc(hull.facesLen * sizeof(HullFace));
+    if(filter == NULL)
+    {
+        retVal = -1;
+    }
+    for(int f = 0; retVal == 0 && f < hull.facesLen; f++)
+    {
+        if(hull.faces[f].alive)
+        {
+            filter[filterLen++] = hull.faces[f];
+        }
+    }
+    for(int i = 0; i < pointsLen && retVal == 0; i++)
+    {
+        bool inside = true;
+        for(int f = 0; f < filterLen && inside; f++)
+        {
+            inside = faceDistance(&hull, &filter[f], i) < -eps;
+        }
+        if(!inside)
+        {
+            retVal = hullInsert(&hull, i);
+        }
+    }
+    free(filter);
+    if(retVal != 0)
+    {
+        freeHull(&hull);
+        return retVal;
+    }
+
+    // collect each vertex once, marking it through startAt.
+    for(int f = 0; f < hull.facesLen; f++)
+    {
+        for(int k = 0; k < 3 && hull.faces[f].alive; k++)
+        {
+            hull.startAt[hull.faces[f].v[k]] = -1;
+        }
+    }
+    for(int f = 0; f < hull.facesLen; f++)
+    {
+        for(int k = 0; k < 3 && hull.faces[f].alive; k++)
+        {
+            int v = hull.faces[f].v[k];
+            if(hull.startAt[v] == -1)
+            {
+                hull.startAt[v] = 0;
+                vertices[(*verticesLen)++] = v;
+            }
+        }
+    }
+    freeHull(&hull);
+    return 0;
+}
+
+
+int hullInsert(Hull *hull, int p)
+{
+    int seed = -1;
+    double farthest = hull->eps;
+    for(int f = 0; f < hull->facesLen; f++)
+    {
+        HullFace *face = &hull->faces[f];
+        double dist = face->alive ? faceDistance(hull, face, p) : 0;
+        if(dist > farthest)
+        {
+            farthest = dist;
+            seed = f;
+        }
+    }
+    if(seed < 0)
+    {
+        return 0;
+    }
+    // the visible faces connected to the seed, marked dead as they are found.
+    int visibleLen = 0;
+    hull->faces[seed].alive = false;
+    hull->visible[visibleLen++] = seed;
+    for(int i = 0; i < visibleLen; i++)
+    {
+        const HullFace *face = &hull->faces[hull->visible[i]];
+        for(int k = 0; k < 3; k++)
+        {
+            HullFace *next = &hull->faces[face->adj[k]];
+            if(next->alive && faceDistance(hull, next, p) > hull->eps)
+            {
+                next->alive = false;
+                hull->visible[visibleLen++] = face->adj[k];
+            }
+        }
+    }
+    // the horizon: edges of visible faces whose neighbour is hidden, at most 3 of each.
+    if(3 * visibleLen > hull->horizonCap)
+    {
+        int *horizon = (int*)realloc(hull->horizon, 3 * 3 * visibleLen * sizeof(int));
+        if(horizon == NULL)
+        {
+            return -1;
+        }
+        hull->horizon = horizon;
+        hull->horizonCap = 3 * visibleLen;
+    }
+    int horizonLen = 0;
+    for(int i = 0; i < visibleLen; i++)
+    {
+        HullFace *face = &hull->faces[hull->visible[i]];
+        for(int k = 0; k < 3; k++)
+        {
+            if(hull->faces[face->adj[k]].alive)
+            {
+                hull->horizon[3 * horizonLen] = face->v[k];
+                hull->horizon[3 * horizonLen + 1] = face->v[(k + 1) % 3];
+                hull->horizon[3 * horizonLen + 2] = face->adj[k];
+                horizonLen++;
+            }
+        }
+        hull->freeFaces[hull->freeLen++] = hull->visible[i];
+    }
+    if(!horizonIsCycle(hull, horizonLen))
+    {
+        return 1;
+    }
+    // a cone of new faces from the horizon to p.
+    for(int i = 0; i < horizonLen; i++)
+    {
+        int a = hull->horizon[3 * i], b = hull->horizon[3 * i + 1];
+        int outer = hull->horizon[3 * i + 2];
+        int f = hullAddFace(hull, a, b, p);
+        if(f < 0)
+        {
+            return -1;
+        }
+        hull->faces[f].adj[0] = outer;
+        for(int m = 0; m < 3; m++)
+        {
+            if(hull->faces[outer].v[m] == b)
+            {
+                hull->faces[outer].adj[m] = f;
+            }
+            // the far vertex of the hidden neighbour must stay below the new face.
+            else if(hull->faces[outer].v[m] != a &&
+                    faceDistance(hull, &hull->faces[f], hull->faces[outer].v[m]) > hull->eps)
+            {
+                return 1;
+            }
+        }
+        hull->startAt[a] = f;
+        hull->endAt[b] = f;
+    }
+    for(int i = 0; i < horizonLen; i++)
+    {
+        HullFace *face = &hull->faces[hull->startAt[hull->horizon[3 * i]]];
+        face->adj[1] = hull->startAt[face->v[1]];
+        face->adj[2] = hull->endAt[face->v[0]];
+    }
+    return 0;
+}
 
 
-int main(int argc, char* argv[])
+bool horizonIsCycle(Hull *hull, int horizonLen)
 {
-    if(argc <= 1)
+    for(int i = 0; i < horizonLen; i++)
     {
-        fprintf(stderr, ARG_ERROR_MSG);
-        exit(EXIT_FAILURE);
+        hull->startAt[hull->horizon[3 * i]] = -1;
+        hull->startAt[hull->horizon[3 * i + 1]] = -1;
+    }
+    for(int i = 0; i < horizonLen; i++)
+    {
+        int from = hull->horizon[3 * i];
+        if(hull->startAt[from] != -1)
+        {
+            return false;
+        }
+        hull->startAt[from] = i;
+    }
+    // follow the edges from the first one: all of them must be passed before it is back.
+    int edge = 0;
+    for(int steps = 1; steps <= horizonLen; steps++)
+    {
+        edge = hull->startAt[hull->horizon[3 * edge + 1]];
+        if(edge < 0 || (edge == 0) != (steps == horizonLen))
+        {
+            return false;
+        }
     }
+    return horizonLen >= 3;
+}
 
-    FILE *file;
-    for (int i = 1; i < argc; i++)
+
+int hullAddFace(Hull *hull, int a, int b, int c)
+{
+    int f;
+    if(hull->freeLen > 0)
+    {
+        f = hull->freeFaces[--hull->freeLen];
+    }
+    else
     {
-        file = fopen(argv[i], "r");
-        if (file == NULL)
+        if(hull->facesLen == hull->facesCap)
         {
-            fprintf(stderr, FILE_NOT_FOUND_MSG, argv[i]);
-            break;
+            int cap = hull->facesCap * 2;
+            HullFace *faces = (HullFace*)realloc(hull->faces, cap * sizeof(HullFace));
+            if(faces == NULL)
+            {
+                return -1;
+            }
+            hull->faces = faces;
+            int *freeFaces = (int*)realloc(hull->freeFaces, cap * sizeof(int));
+            if(freeFaces == NULL)
+            {
+                return -1;
+            }
+            hull->freeFaces = freeFaces;
+            int *visible = (int*)realloc(hull->visible, cap * sizeof(int));
+            if(visible == NULL)
+            {
+                return -1;
+            }
+            hull->visible = visible;
+            hull->facesCap = cap;
         }
-        analyzeProtein(file, argv[i]);
-        fclose(file);
+        f = hull->facesLen++;
     }
-    return 0;
+    HullFace *face = &hull->faces[f];
+    const double *pa = hull->points + 3 * a, *pb = hull->points + 3 * b, *pc = hull->points + 3 * c;
+    double ab[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+    double ac[3] = {pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2]};
+    face->normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    face->normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    face->normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+    double len = sqrt(face->normal[0] * face->normal[0] + face->normal[1] * face->normal[1] +
+                      face->normal[2] * face->normal[2]);
+    for(int k = 0; k < 3 && len > 0; k++)
+    {
+        face->normal[k] /= len;
+    }
+    face->offset = face->normal[0] * pa[0] + face->normal[1] * pa[1] + face->normal[2] * pa[2];
+    face->v[0] = a;
+    face->v[1] = b;
+    face->v[2] = c;
+    face->alive = true;
+    return f;
 }
 
 
-void analyzeProtein(FILE *file, const char* file_name)
+double faceDistance(const Hull *hull, const HullFace *face, int p)
 {
-    int atomsRead = 0;
-    float radius = 0, dMax = 0;
-    float centerMass[3];
-    float proteinCords[MAX_ATOMS][3];
-    char line[81];
-    while(fgets(line, 80, file) != NULL || atomsRead > MAX_ATOMS)
+    return planeDistance(face, hull->points + 3 * p);
+}
+
+
+double planeDistance(const HullFace *face, const double point[3])
+{
+    return face->normal[0] * point[0] + face->normal[1] * point[1] +
+           face->normal[2] * point[2] - face->offset;
+}
+
+
+void extremeDirection(int e, double d[3])
+{
+    int dir = e < EXTREME_DIRECTIONS / 2 ? e : e + 1;  // skip the zero direction.
+    d[0] = dir / 9 - 1;
+    d[1] = (dir / 3) % 3 - 1;
+    d[2] = dir % 3 - 1;
+}
+
+
+void freeHull(Hull *hull)
+{
+    free(hull->faces);
+    free(hull->freeFaces);
+    free(hull->visible);
+    free(hull->horizon);
+    free(hull->startAt);
+    free(hull->endAt);
+}
+
+
+void calcRadius(const CordStore *cords, const Kernels *kernels, int threads,
+                const float *centerMass, float *radius)
+{
+    const double center[3] = {centerMass[0], centerMass[1], centerMass[2]};
+    double sums[3];
+    reduceBlocks(cords, kernels, center, threads, sums);
+    double xAverage = sums[0] / cords->len;
+    double yAverage = sums[1] / cords->len;
+    double zAverage = sums[2] / cords->len;
+
+    *radius = (float)sqrt(xAverage + yAverage + zAverage);
+}
+
+
+void calCenterMass(const CordStore *cords, const Kernels *kernels, int threads,
+                   float *centerMass)
+{
+    double sums[3];
+    reduceBlocks(cords, kernels, NULL, threads, sums);
+
+    centerMass[0] = (float)(sums[0] / cords->len);
+    centerMass[1] = (float)(sums[1] / cords->len);
+    centerMass[2] = (float)(sums[2] / cords->len);
+}
+
+
+void reduceBlocks(const CordStore *cords, const Kernels *kernels, const double *center,
+                  int threads, double sums[3])
+{
+    int blocksLen = (cords->len + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+    Reduction reduction = {cords, kernels, center, NULL, blocksLen, 0,
+                           PTHREAD_MUTEX_INITIALIZER};
+    threads = threads < blocksLen ? threads : blocksLen;
+    pthread_t *ids = NULL;
+    if(threads > 1)
+    {
+        // threads keep their blocks until all are done, to combine them in order.
+        reduction.blocks = (double(*)[3])malloc(blocksLen * sizeof(*reduction.blocks));
+        ids = reduction.blocks == NULL ? NULL : (pthread_t*)malloc(threads * sizeof(pthread_t));
+    }
+    if(ids != NULL)
     {
-        char atom[5];
-        strncpy(atom, line, 4);
+        int started = 1;
+        for(; started < threads; started++)
+        {
+            if(pthread_create(&ids[started], NULL, reductionWorker, &reduction) != 0)
+            {
+                break;
+            }
+        }
+        reductionWorker(&reduction);
+        for(int t = 1; t < started; t++)
+        {
+            pthread_join(ids[t], NULL);
+        }
+    }
 
-        if(strcmp(atom, ATOM) == 0)
+    double sum[3] = {0, 0, 0}, compensation[3] = {0, 0, 0};
+    for(int b = 0; b < blocksLen; b++)
+    {
+        double block[3];
+        if(ids == NULL)
         {
-            extractCords(line, proteinCords[atomsRead]);
-            atomsRead++;
-            continue;
+            sumBlock(&reduction, b, block);  // one thread sums the same blocks in order.
+        }
+        else
+        {
+            memcpy(block, reduction.blocks[b], sizeof(block));
         }
+        for(int k = 0; k < 3; k++)
+        {
+            addCompensated(&sum[k], &compensation[k], block[k]);
+        }
+    }
+    for(int k = 0; k < 3; k++)
+    {
+        sums[k] = sum[k] + compensation[k];
     }
-    calCenterMass(proteinCords, &atomsRead, centerMass);
-    calcRadius(proteinCords, &atomsRead, centerMass, &radius);
-    calcDmax(proteinCords, &atomsRead, &dMax);
-    report(file_name, &atomsRead, &radius, &dMax, centerMass);
+    free(ids);
+    free(reduction.blocks);
+    pthread_mutex_destroy(&reduction.lock);
 }
 
 
-void report(const char *file_name, const int *atoms, const float *radius,
-            const float *dMax, const float centerMass[])
+void *reductionWorker(void *arg)
 {
-    printf(FILE_STATS_MSG, file_name, *atoms);
-    printf(CENTER_MASS_MSG, centerMass[0], centerMass[1], centerMass[2]);
-    printf(ORB_RADIUS_MSG, *radius);
-    printf(MAX_DISTANCE_MSG, *dMax);
+    Reduction *reduction = (Reduction*)arg;
+    while(true)
+    {
+        pthread_mutex_lock(&reduction->lock);
+        int b = reduction->next++;
+        pthread_mutex_unlock(&reduction->lock);
+        if(b >= reduction->blocksLen)
+        {
+            return NULL;
+        }
+        sumBlock(reduction, b, reduction->blocks[b]);
+    }
 }
 
 
-void extractCords(const char *line, float cords[3])
+void sumBlock(const Reduction *reduction, int b, double sums[3])
 {
-    char xCord[8], yCord[8], zCord[8];
-    strncpy (xCord, line + 31, 7);
-    strncpy (yCord, line + 39, 7);
-    strncpy (zCord, line + 47, 7);
+    // blocks start at multiples of REDUCE_BLOCK, so they keep the alignment of the store.
+    const CordStore *cords = reduction->cords;
+    long start = (long)b * REDUCE_BLOCK;
+    CordStore view = {cords->x + start, cords->y + start, cords->z + start,
+                      cords->len - start < REDUCE_BLOCK ? (int)(cords->len - start)
+                                                        : REDUCE_BLOCK,
+                      REDUCE_BLOCK};
+    if(reduction->center == NULL)
+    {
+        reduction->kernels->sum(&view, sums);
+    }
+    else
+    {
+        reduction->kernels->squares(&view, reduction->center, sums);
+    }
+}
+
 
-    stringToFloat(xCord, &cords[0]);
-    stringToFloat(yCord, &cords[1]);
-    stringToFloat(zCord, &cords[2]);
+void addCompensated(double *sum, double *compensation, double value)
+{
+    double total = *sum + value;
+    *compensation += fabs(*sum) >= fabs(value) ? (*sum - total) + value : (value - total) + *sum;
+    *sum = total;
 }
 
 
-void stringToFloat(const char convertMe[], float* dest)
+int initCordStore(CordStore *cords, int cap)
 {
-    char *end;
-    float result = 0;
-    errno = 0;
-    result = strtof(convertMe, &end);
-    if(result == 0 && (errno != 0 || end == convertMe))
+    cords->len = 0;
+    cords->cap = cap;
+    cords->x = NULL;
+    cords->y = NULL;
+    cords->z = NULL;
+    // round up so kernels may load whole vectors past the last atom.
+    size_t bytes = axisBytes(cap);
+    if(posix_memalign((void**)&cords->x, CORDS_ALIGNMENT, bytes) != 0 ||
+       posix_memalign((void**)&cords->y, CORDS_ALIGNMENT, bytes) != 0 ||
+       posix_memalign((void**)&cords->z, CORDS_ALIGNMENT, bytes) != 0)
     {
-        fprintf(stderr, CONVERSION_ERR_MSG, convertMe);
-        exit(EXIT_FAILURE);
+        freeCordStore(cords);
+        return -1;
     }
-    *dest = result;
+    return 0;
+}
+
+
+int pushCord(CordStore *cords, const float cord[3])
+{
+    if(cords->len == cords->cap && growCordStore(cords) < 0)
+    {
+        return -1;
+    }
+    cords->x[cords->len] = cord[0];
+    cords->y[cords->len] = cord[1];
+    cords->z[cords->len] = cord[2];
+    cords->len++;
+    return 0;
+}
+
+
+int growCordStore(CordStore *cords)
+{
+    CordStore grown;
+    if(initCordStore(&grown, cords->cap > 0 ? 2 * cords->cap : INITIAL_ATOMS) < 0)
+    {
+        return -1;
+    }
+    memcpy(grown.x, cords->x, cords->len * sizeof(float));
+    memcpy(grown.y, cords->y, cords->len * sizeof(float));
+    memcpy(grown.z, cords->z, cords->len * sizeof(float));
+    grown.len = cords->len;
+    freeCordStore(cords);
+    *cords = grown;
+    return 0;
+}
+
+
+void freeCordStore(CordStore *cords)
+{
+    free(cords->x);
+    free(cords->y);
+    free(cords->z);
+    cords->x = NULL;
+    cords->y = NULL;
+    cords->z = NULL;
+}
+
+
+const Kernels *selectKernels(const char *name)
+{
+    static const Kernels scalar = {KERNEL_SCALAR, sumScalar, squaresScalar, maxDistanceScalar,
+                                   covarianceScalar};
+#ifdef X86_KERNELS
+    static const Kernels sse = {KERNEL_SSE, sumSse, squaresSse, maxDistanceSse, covarianceSse};
+    static const Kernels avx2 = {KERNEL_AVX2, sumAvx2, squaresAvx2, maxDistanceAvx2,
+                                 covarianceAvx2};
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+    bool hasSse = __builtin_cpu_supports("sse2");
+    if((strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_AVX2) == 0) && hasAvx2)
+    {
+        return &avx2;
+    }
+    if((strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_SSE) == 0) && hasSse)
+    {
+        return &sse;
+    }
+#endif
+    if(strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_SCALAR) == 0)
+    {
+        return &scalar;
+    }
+    return NULL;
+}
+
+
+void sumScalar(const CordStore *cords, double sums[3])
+{
+    double xSum = 0, ySum = 0, zSum = 0;
+    for(int i = 0; i < cords->len; i++)
+    {
+        xSum += cords->x[i];
+        ySum += cords->y[i];
+        zSum += cords->z[i];
+    }
+    sums[0] = xSum;
+    sums[1] = ySum;
+    sums[2] = zSum;
+}
+
+
+void squaresScalar(const CordStore *cords, const double center[3], double sums[3])
+{
+    double xSum = 0, ySum = 0, zSum = 0;
+    for(int i = 0; i < cords->len; i++)
+    {
+        double xDiff = cords->x[i] - center[0];
+        double yDiff = cords->y[i] - center[1];
+        double zDiff = cords->z[i] - center[2];
+        xSum += xDiff * xDiff;
+        ySum += yDiff * yDiff;
+        zSum += zDiff * zDiff;
+    }
+    sums[0] = xSum;
+    sums[1] = ySum;
+    sums[2] = zSum;
+}
+
+
+float maxDistanceScalar(const CordStore *cords, int from, int to, const float p[3])
+{
+    float best = 0;
+    for(int j = from; j < to; j++)
+    {
+        float xDiff = p[0] - cords->x[j];
+        float yDiff = p[1] - cords->y[j];
+        float zDiff = p[2] - cords->z[j];
+        float sol = xDiff * xDiff + yDiff * yDiff + zDiff * zDiff;
+        best = sol > best ? sol : best;
+    }
+    return best;
+}
+
+
+void covarianceScalar(const CordStore *a, const CordStore *b, double cov[9])
+{
+    const float *aAxes[3] = {a->x, a->y, a->z}, *bAxes[3] = {b->x, b->y, b->z};
+    for(int c = 0; c < 9; c++)
+    {
+        cov[c] = 0;
+    }
+    for(int i = 0; i < a->len; i++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            for(int l = 0; l < 3; l++)
+            {
+                cov[3 * k + l] += (double)aAxes[k][i] * bAxes[l][i];
+            }
+        }
+    }
+}
+
+
+#ifdef X86_KERNELS
+__attribute__((target("sse2")))
+void sumSse(const CordStore *cords, double sums[3])
+{
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    int vecLen = cords->len - cords->len % 4;
+    for(int k = 0; k < 3; k++)
+    {
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        for(int i = 0; i < vecLen; i += 4)
+        {
+            __m128 v = _mm_load_ps(axes[k] + i);
+            low = _mm_add_pd(low, _mm_cvtps_pd(v));
+            high = _mm_add_pd(high, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(low, high));
+        sums[k] = lanes[0] + lanes[1];
+        for(int i = vecLen; i < cords->len; i++)
+        {
+            sums[k] += axes[k][i];
+        }
+    }
+}
+
+
+__attribute__((target("sse2")))
+void squaresSse(const CordStore *cords, const double center[3], double sums[3])
+{
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    int vecLen = cords->len - cords->len % 4;
+    for(int k = 0; k < 3; k++)
+    {
+        __m128d c = _mm_set1_pd(center[k]);
+        __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+        for(int i = 0; i < vecLen; i += 4)
+        {
+            __m128 v = _mm_load_ps(axes[k] + i);
+            __m128d lowDiff = _mm_sub_pd(_mm_cvtps_pd(v), c);
+            __m128d highDiff = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), c);
+            low = _mm_add_pd(low, _mm_mul_pd(lowDiff, lowDiff));
+            high = _mm_add_pd(high, _mm_mul_pd(highDiff, highDiff));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(low, high));
+        sums[k] = lanes[0] + lanes[1];
+        for(int i = vecLen; i < cords->len; i++)
+        {
+            double diff = axes[k][i] - center[k];
+            sums[k] += diff * diff;
+        }
+    }
+}
+
+
+__attribute__((target("sse2")))
+float maxDistanceSse(const CordStore *cords, int from, int to, const float p[3])
+{
+    __m128 px = _mm_set1_ps(p[0]), py = _mm_set1_ps(p[1]), pz = _mm_set1_ps(p[2]);
+    __m128 best = _mm_setzero_ps();
+    int vecEnd = to - (to - from) % 4;
+    for(int j = from; j < vecEnd; j += 4)
+    {
+        __m128 xDiff = _mm_sub_ps(px, _mm_load_ps(cords->x + j));
+        __m128 yDiff = _mm_sub_ps(py, _mm_load_ps(cords->y + j));
+        __m128 zDiff = _mm_sub_ps(pz, _mm_load_ps(cords->z + j));
+        __m128 sol = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xDiff, xDiff), _mm_mul_ps(yDiff, yDiff)),
+                                _mm_mul_ps(zDiff, zDiff));
+        best = _mm_max_ps(best, sol);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, best);
+    float result = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+    for(int j = vecEnd; j < to; j++)
+    {
+        float xDiff = p[0] - cords->x[j];
+        float yDiff = p[1] - cords->y[j];
+        float zDiff = p[2] - cords->z[j];
+        float sol = xDiff * xDiff + yDiff * yDiff + zDiff * zDiff;
+        result = sol > result ? sol : result;
+    }
+    return result;
 }
 
 
-void calcDmax(float cords[][3], const int *cordsLen, float *dMax)
+__attribute__((target("sse2")))
+void covarianceSse(const CordStore *a, const CordStore *b, double cov[9])
 {
-    for(int i = 0; i < *cordsLen; i++)
+    const float *aAxes[3] = {a->x, a->y, a->z}, *bAxes[3] = {b->x, b->y, b->z};
+    int vecLen = a->len - a->len % 4;
+    __m128d sums[9];
+    for(int c = 0; c < 9; c++)
+    {
+        sums[c] = _mm_setzero_pd();
+    }
+    for(int i = 0; i < vecLen; i += 4)
+    {
+        __m128d aLow[3], aHigh[3], bLow[3], bHigh[3];
+        for(int k = 0; k < 3; k++)
+        {
+            __m128 v = _mm_load_ps(aAxes[k] + i), w = _mm_load_ps(bAxes[k] + i);
+            aLow[k] = _mm_cvtps_pd(v);
+            aHigh[k] = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+            bLow[k] = _mm_cvtps_pd(w);
+            bHigh[k] = _mm_cvtps_pd(_mm_movehl_ps(w, w));
+        }
+        for(int k = 0; k < 3; k++)
+        {
+            for(int l = 0; l < 3; l++)
+            {
+                sums[3 * k + l] = _mm_add_pd(sums[3 * k + l],
+                                             _mm_add_pd(_mm_mul_pd(aLow[k], bLow[l]),
+                                                        _mm_mul_pd(aHigh[k], bHigh[l])));
+            }
+        }
+    }
+    for(int k = 0; k < 3; k++)
     {
-        for(int j = 0; j < i; j++)
+        for(int l = 0; l < 3; l++)
         {
-            float xDiff = powf(cords[i][0] - cords[j][0], 2);
-            float yDiff = powf(cords[i][1] - cords[j][1], 2);
-            float zDiff = powf(cords[i][2] - cords[j][2], 2);
-            float sol = sqrtf(xDiff + yDiff + zDiff);
-            if (*dMax < sol)
+            double lanes[2];
+            _mm_storeu_pd(lanes, sums[3 * k + l]);
+            cov[3 * k + l] = lanes[0] + lanes[1];
+            for(int i = vecLen; i < a->len; i++)
             {
-                *dMax = sol;
+                cov[3 * k + l] += (double)aAxes[k][i] * bAxes[l][i];
             }
         }
     }
 }
 
 
-void calcRadius(float cords[][3], const int *cordsLen, const float *centerMass, float *radius)
+__attribute__((target("avx2")))
+void sumAvx2(const CordStore *cords, double sums[3])
 {
-    float xAverage = 0, yAverage = 0, zAverage = 0;
-    for(int i = 0; i < *cordsLen; i++)
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    int vecLen = cords->len - cords->len % 8;
+    for(int k = 0; k < 3; k++)
     {
-        xAverage += powf(centerMass[0] - cords[i][0], 2);
-        yAverage += powf(centerMass[1] - cords[i][1], 2);
-        zAverage += powf(centerMass[2] - cords[i][2], 2);
+        __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+        for(int i = 0; i < vecLen; i += 8)
+        {
+            __m256 v = _mm256_load_ps(axes[k] + i);
+            low = _mm256_add_pd(low, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            high = _mm256_add_pd(high, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_add_pd(low, high));
+        sums[k] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for(int i = vecLen; i < cords->len; i++)
+        {
+            sums[k] += axes[k][i];
+        }
     }
-    xAverage /= *cordsLen;
-    yAverage /= *cordsLen;
-    zAverage /= *cordsLen;
+}
 
-    *radius = sqrtf(xAverage + yAverage + zAverage);
+
+__attribute__((target("avx2")))
+void squaresAvx2(const CordStore *cords, const double center[3], double sums[3])
+{
+    const float *axes[3] = {cords->x, cords->y, cords->z};
+    int vecLen = cords->len - cords->len % 8;
+    for(int k = 0; k < 3; k++)
+    {
+        __m256d c = _mm256_set1_pd(center[k]);
+        __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+        for(int i = 0; i < vecLen; i += 8)
+        {
+            __m256 v = _mm256_load_ps(axes[k] + i);
+            __m256d lowDiff = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), c);
+            __m256d highDiff = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), c);
+            low = _mm256_add_pd(low, _mm256_mul_pd(lowDiff, lowDiff));
+            high = _mm256_add_pd(high, _mm256_mul_pd(highDiff, highDiff));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_add_pd(low, high));
+        sums[k] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for(int i = vecLen; i < cords->len; i++)
+        {
+            double diff = axes[k][i] - center[k];
+            sums[k] += diff * diff;
+        }
+    }
 }
 
 
-void calCenterMass(float cords[][3], const int *cordsLen, float *centerMass)
+__attribute__((target("avx2")))
+float maxDistanceAvx2(const CordStore *cords, int from, int to, const float p[3])
 {
-    float xAverage = 0, yAverage = 0, zAverage = 0;
-    for(int i = 0; i < *cordsLen; i++)
+    __m256 px = _mm256_set1_ps(p[0]), py = _mm256_set1_ps(p[1]), pz = _mm256_set1_ps(p[2]);
+    __m256 best = _mm256_setzero_ps();
+    int vecEnd = to - (to - from) % 8;
+    for(int j = from; j < vecEnd; j += 8)
     {
-        xAverage += cords[i][0];
-        yAverage += cords[i][1];
-        zAverage += cords[i][2];
+        __m256 xDiff = _mm256_sub_ps(px, _mm256_load_ps(cords->x + j));
+        __m256 yDiff = _mm256_sub_ps(py, _mm256_load_ps(cords->y + j));
+        __m256 zDiff = _mm256_sub_ps(pz, _mm256_load_ps(cords->z + j));
+        __m256 sol = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xDiff, xDiff),
+                                                 _mm256_mul_ps(yDiff, yDiff)),
+                                   _mm256_mul_ps(zDiff, zDiff));
+        best = _mm256_max_ps(best, sol);
     }
-    xAverage /= *cordsLen;
-    yAverage /= *cordsLen;
-    zAverage /= *cordsLen;
+    float lanes[8];
+    _mm256_storeu_ps(lanes, best);
+    float result = 0;
+    for(int k = 0; k < 8; k++)
+    {
+        result = lanes[k] > result ? lanes[k] : result;
+    }
+    for(int j = vecEnd; j < to; j++)
+    {
+        float xDiff = p[0] - cords->x[j];
+        float yDiff = p[1] - cords->y[j];
+        float zDiff = p[2] - cords->z[j];
+        float sol = xDiff * xDiff + yDiff * yDiff + zDiff * zDiff;
+        result = sol > result ? sol : result;
+    }
+    return result;
+}
 
-    centerMass[0] = xAverage;
-    centerMass[1] = yAverage;
-    centerMass[2] = zAverage;
+
+__attribute__((target("avx2")))
+void covarianceAvx2(const CordStore *a, const CordStore *b, double cov[9])
+{
+    const float *aAxes[3] = {a->x, a->y, a->z}, *bAxes[3] = {b->x, b->y, b->z};
+    int vecLen = a->len - a->len % 8;
+    __m256d sums[9];
+    for(int c = 0; c < 9; c++)
+    {
+        sums[c] = _mm256_setzero_pd();
+    }
+    for(int i = 0; i < vecLen; i += 8)
+    {
+        __m256d aLow[3], aHigh[3], bLow[3], bHigh[3];
+        for(int k = 0; k < 3; k++)
+        {
+            __m256 v = _mm256_load_ps(aAxes[k] + i), w = _mm256_load_ps(bAxes[k] + i);
+            aLow[k] = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+            aHigh[k] = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+            bLow[k] = _mm256_cvtps_pd(_mm256_castps256_ps128(w));
+            bHigh[k] = _mm256_cvtps_pd(_mm256_extractf128_ps(w, 1));
+        }
+        for(int k = 0; k < 3; k++)
+        {
+            for(int l = 0; l < 3; l++)
+            {
+                sums[3 * k + l] = _mm256_add_pd(sums[3 * k + l],
+                                                _mm256_add_pd(_mm256_mul_pd(aLow[k], bLow[l]),
+                                                              _mm256_mul_pd(aHigh[k], bHigh[l])));
+            }
+        }
+    }
+    for(int k = 0; k < 3; k++)
+    {
+        for(int l = 0; l < 3; l++)
+        {
+            double lanes[4];
+            _mm256_storeu_pd(lanes, sums[3 * k + l]);
+            cov[3 * k + l] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            for(int i = vecLen; i < a->len; i++)
+            {
+                cov[3 * k + l] += (double)aAxes[k][i] * bAxes[l][i];
+            }
+        }
+    }
 }
+#endif
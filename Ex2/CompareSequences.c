@@ -3,17 +3,313 @@
 #include <stdbool.h>
 #include <memory.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
 
 #define READ_MODE "r"
 #define SEQUENCE_HEADER '>'
-#define INV_ARG "Usage: <file path> <match> <mismatch> <gap>\n"
+#define INV_ARG "Usage: <file path> <match> <mismatch> <gap> [--align=text|cigar] " \
+                "[--threads=N] [--kernel=auto|avx2|sse4.1|scalar] " \
+                "[--band=W|auto] [--xdrop=X] [--matrix=PATH] [--gap-open=O] [--local] " \
+                "[--prefilter=P] [--kmer=K]\n"
+#define UNKNOWN_OPTION "Unknown option: %s\n"
+#define COMBINE_ERR "--band, --xdrop, --align, --local and affine scoring can not be combined\n"
+#define MATRIX_ERR "Invalid substitution matrix %s\n"
+#define LETTER_ERR "Letter %c is not in the substitution matrix\n"
+#define KERNEL_ERR "Kernel %s is not supported by this CPU\n"
 #define INVALID_INP "Invalid input\n"
 #define OPEN_FILE_ERR "Can not open file\n. Please enter a valid path.\n"
 #define MEM_FAULT "Memory allocation failed!\n"
 #define SCORE_MSG "Score for alignment of seq%d to seq%d is %d\n"
+#define SKIP_MSG "Alignment of seq%d to seq%d skipped, estimated similarity %d%%\n"
 #define INV_SEQ "The input file should contain at least 2 sequences!\n"
-#define MAX_SEQUENCES 100
-#define MAX_LINE 100
+#define READ_BLOCK (1 << 16)  // bytes read from the input at a time.
+#define INITIAL_ARENA 4096
+#define INITIAL_SEQUENCES 64
+#define FIRST_OPTION 5  // options follow the file path and the 3 weights.
+#define OPTION_PREFIX "--"
+#define ALIGN_OPTION "--align="
+#define ALIGN_TEXT "text"
+#define ALIGN_CIGAR "cigar"
+#define THREADS_OPTION "--threads="
+#define KERNEL_OPTION "--kernel="
+#define KERNEL_AUTO "auto"
+#define KERNEL_AVX2 "avx2"
+#define KERNEL_SSE "sse4.1"
+#define KERNEL_SCALAR "scalar"
+#define DP_ROWS 7  // rows or anti-diagonals a kernel keeps: 3 of scores, 2 of each gap state.
+#define SCORE_DIAGONALS 3  // anti-diagonals of scores: the one filled and the 2 before it.
+#define GAP_DIAGONALS 2  // anti-diagonals of a gap state: the one filled and the one before.
+#define BAND_OPTION "--band="
+#define BAND_AUTO "auto"
+#define ADAPTIVE_BAND -1  // a band doubled until its score is provably optimal.
+#define BAND_START 16  // first width of an adaptive band.
+#define XDROP_OPTION "--xdrop="
+#define NO_SCORE (INT_MIN / 2)  // cells off the band or dropped, below any real score.
+#define MATRIX_OPTION "--matrix="
+#define GAP_OPEN_OPTION "--gap-open="
+#define MATRIX_COMMENT '#'
+#define MATRIX_ANY '*'  // the row of letters missing from a matrix, if it has one.
+#define MATRIX_SEPARATORS " \t\r\n"
+#define MATRIX_LINE 4096
+#define NO_LETTER UCHAR_MAX  // code of a letter out of the alphabet.
+#define LOCAL_OPTION "--local"
+#define WORD_BITS 64  // letters of seq1 in a block of the bit-vector edit distance.
+#define HIGH_BIT ((uint64_t)1 << (WORD_BITS - 1))
+#define PREFILTER_OPTION "--prefilter="
+#define KMER_OPTION "--kmer="
+#define KMER_DEFAULT 12
+#define SKETCH_SIZE 1024  // smallest k-mer hashes kept of each sequence.
+#define KMER_BASE 0x100000001b3ULL  // of the rolling hash of a k-mer.
+#define FULL_SIMILARITY 100
+#define LANES_OVERFLOW 1  // returned by a striped pass whose lanes are too narrow for the score.
+#define MATCH_OP 'M'  // a letter of seq1 against a letter of seq2.
+#define DELETE_OP 'D'  // a letter of seq1 against a gap.
+#define INSERT_OP 'I'  // a gap against a letter of seq2.
+#define GAP_CHAR '-'
+#define CIGAR_OP "%d%c"
+#define PAIR_BLOCK (1 << 16)  // pairs scored in parallel before their results are printed.
+#define BASE_CELLS 4096  // subproblems up to this many table cells are traced back in full.
+
+
+/**
+ * How the alignment of each pair is printed after its score.
+ */
+enum AlignOutput
+{
+    noAlign,
+    textAlign,  // both sequences with GAP_CHAR at the gaps, a line each.
+    cigarAlign  // a line of run lengths of MATCH_OP, DELETE_OP and INSERT_OP.
+};
+
+/**
+ * What became of a pair of a block scored in parallel.
+ */
+enum PairState
+{
+    failedPair,  // not scored yet, or for lack of memory.
+    scoredPair,
+    skippedPair  // by the prefilter.
+};
+
+/**
+ * The sequences of the input. Their letters are stored one after the other in a single
+ * arena, each followed by '\0', and found through an index of offsets and lengths.
+ */
+typedef struct SequenceSet
+{
+    char *arena;
+    size_t arenaLen;
+    size_t arenaCap;
+    size_t *offsets;  // start of each sequence in the arena.
+    int *lens;
+    int count;
+    int cap;  // room of offsets and lens.
+} SequenceSet;
+
+/**
+ * A substitution matrix over an alphabet, and affine gap weights: a gap of k letters weighs
+ * gapOpen + k * gapExtend.
+ */
+typedef struct Scoring
+{
+    unsigned char codes[UCHAR_MAX + 1];  // index of each letter in the alphabet, or NO_LETTER.
+    int alphabetLen;
+    int *matrix;  // alphabetLen x alphabetLen weights, symmetric.
+    int gapOpen;
+    int gapExtend;
+} Scoring;
+
+/**
+ * Rows of the score table, kept between comparisons so their memory is allocated once for
+ * the longest sequence.
+ */
+typedef struct DpWorkspace
+{
+    int *rows;  // DP_ROWS rows, rowCap each.
+    int rowCap;
+    char *letters;  // a sequence reversed, or letter codes, for the anti-diagonal kernels.
+    int lettersCap;
+    int *profile;  // the query profile of the affine scalar kernel.
+    size_t profileCap;
+} DpWorkspace;
+
+/**
+ * Anti-diagonals filled by the affine kernels, and the letter codes along them.
+ */
+typedef struct AffineDiagonals
+{
+    int *scores[SCORE_DIAGONALS];  // diagonal d at d % SCORE_DIAGONALS.
+    int *gaps1[GAP_DIAGONALS];  // best scores ending in a gap in seq1, d at d % GAP_DIAGONALS.
+    int *gaps2[GAP_DIAGONALS];  // best scores ending in a gap in seq2.
+    const unsigned char *codes1;  // codes of seq1.
+    const unsigned char *reversed;  // codes of seq2 reversed.
+} AffineDiagonals;
+
+/**
+ * The striped layout of the local vector kernels: seq1 is cut into a segment for each lane of
+ * a vector, and vector k of a column holds letter k of every segment.
+ */
+typedef struct StripedProfile
+{
+    void *weights;  // segmentLen vectors for each letter code: the weights against seq1, biased.
+    void *columns[2];  // scores of the column of seq2 before, and of the one filled.
+    unsigned char codes[UCHAR_MAX + 1];  // code of each letter of seq2, or NO_LETTER.
+    int segmentLen;  // letters of a segment, and vectors of a column.
+} StripedProfile;
+
+/**
+ * Implementation of the score of a pair for an instruction set.
+ */
+typedef struct Kernel
+{
+    const char *name;
+    /** score of seq1 against seq2, where seq1 is not the longer. 0 upon success, -1 if memory
+     * allocation failed. */
+    int (*score)(const char *seq1, int len1, const char *seq2, int len2,
+                 const int *match, const int *misMatch, const int *gap,
+                 DpWorkspace *workspace, int *score);
+    /** the same with a substitution matrix and affine gaps. */
+    int (*affineScore)(const char *seq1, int len1, const char *seq2, int len2,
+                       const Scoring *scoring, DpWorkspace *workspace, int *score);
+    /** the score of the best local alignment, as score. */
+    int (*localScore)(const char *seq1, int len1, const char *seq2, int len2,
+                      const int *match, const int *misMatch, const int *gap,
+                      DpWorkspace *workspace, int *score);
+} Kernel;
+
+/**
+ * Command line options, given after the weights.
+ */
+typedef struct Options
+{
+    enum AlignOutput align;
+    int threads;  // threads sharing the pairs, or aligning the only pair.
+    const Kernel *kernel;
+    int band;  // cells each side of the diagonal, 0 for the full table, or ADAPTIVE_BAND.
+    int xDrop;  // drop cells this far below the best score, 0 never.
+    const char *matrixPath;  // NULL to score by the match and mismatch weights.
+    int gapOpen;
+    const Scoring *scoring;  // set once the sequences are read, NULL for linear gaps.
+    bool local;  // score the best alignment of any parts of the pair.
+    int prefilter;  // least estimated similarity in percent of the pairs scored, 0 for all.
+    int kmer;  // letters of the k-mers of the prefilter.
+} Options;
+
+/**
+ * An optimal alignment of two sequences.
+ */
+typedef struct Alignment
+{
+    char *ops;  // MATCH_OP, DELETE_OP or INSERT_OP for each column of the alignment.
+    int opsLen;
+    int score;
+} Alignment;
+
+/**
+ * Last row of the score table of a pair, computed by rowWorker.
+ */
+typedef struct RowTask
+{
+    const char *seq1;
+    int len1;
+    const char *seq2;
+    int len2;
+    int step;  // 1 to read the sequences forward, -1 to read them backward from their ends.
+    const int *match;
+    const int *misMatch;
+    const int *gap;
+    DpWorkspace workspace;
+    const int *row;  // NULL if memory allocation failed. (output)
+} RowTask;
+
+/**
+ * A subproblem of Hirschberg's recursion: aligning seq1 to seq2, run by alignWorker.
+ */
+typedef struct AlignTask
+{
+    const char *seq1;
+    int len1;
+    const char *seq2;
+    int len2;
+    const int *match;
+    const int *misMatch;
+    const int *gap;
+    int threads;
+    char *ops;  // room for len1 + len2 operations. (output)
+    int opsLen;  // (output)
+    int retVal;  // (output)
+} AlignTask;
+
+/**
+ * A pair of sequences to score, and an estimate of its cost.
+ */
+typedef struct PairJob
+{
+    int index;  // position of the pair in SCORE_MSG order, within its block.
+    int first;
+    int second;
+    long long cells;  // cells of its score table.
+} PairJob;
+
+/**
+ * Jobs owned by a thread: it takes them from the head, longest first, and other threads
+ * steal from the tail once their own deque is empty. The deques are strided views of the
+ * same sorted jobs, so thread t owns jobs t, t + threads, t + 2 * threads...
+ */
+typedef struct JobDeque
+{
+    pthread_mutex_t lock;
+    const PairJob *jobs;
+    int stride;
+    int head;  // in jobs of the deque, each stride jobs apart.
+    int tail;
+} JobDeque;
+
+/**
+ * State shared by the threads scoring all pairs.
+ */
+typedef struct PairScheduler
+{
+    const SequenceSet *sequences;
+    const int *match;
+    const int *misMatch;
+    const int *gap;
+    const Options *options;
+    JobDeque *deques;
+    int threads;
+    // the results of the block being scored, indexed by PairJob index.
+    int *scores;  // the score of a scored pair, the estimated similarity of a skipped one.
+    signed char *states;  // enum PairState of each pair.
+    Alignment *alignments;  // NULL unless aligning.
+} PairScheduler;
+
+/**
+ * MinHash sketches of the sequences: the SKETCH_SIZE smallest hashes of the k-mers of each,
+ * from which the Jaccard similarity of the k-mers of a pair is estimated.
+ */
+typedef struct SketchSet
+{
+    uint64_t *hashes;  // SKETCH_SIZE for each sequence, ascending.
+    int *lens;  // hashes in each sketch, fewer if a sequence has less distinct k-mers.
+} SketchSet;
+
+/**
+ * Argument of a pairWorker thread.
+ */
+typedef struct PairWorker
+{
+    PairScheduler *scheduler;
+    int id;  // the deque it owns.
+    DpWorkspace workspace;  // kept from block to block.
+    pthread_t thread;
+    bool started;
+} PairWorker;
 
 
 /**
@@ -24,223 +320,3251 @@
  */
 int s2i(const char* convertMe, int *converted);
 
-/**
- * Frees all allocated data.
- * @param sequences : char** array (of pointers) to be freed.
- */
-void cleanUp(char **sequences);
+/**
+ * Frees all allocated data.
+ * @param sequences the sequences to be freed.
+ */
+void cleanUp(SequenceSet *sequences);
+
+
+/**
+ * @param x first integer
+ * @param y second integer
+ * @return * Return the pointer of the lerger integer. If x==y, y is returned.
+ */
+const int *myMax(const int *x, const int *y);
+
+/**
+ * Read the sequences of a file in one pass, a block at a time. A line starting with
+ * SEQUENCE_HEADER or an empty line ends the current sequence, and the following lines are
+ * concatenated into the next one. A line ends at '\r' or '\n'.
+ * @param file pointer to a file to read from relevant sequences
+ * @param sequences the sequences read, to be freed with cleanUp even upon failure. (output)
+ * @return 0 upon success, -1 if memory allocation failed or there are less than 2 sequences.
+ */
+int extractSequences(FILE *file, SequenceSet *sequences);
+
+/**
+ * Append letters to the last sequence, starting a new one if none is open.
+ * @param sequences the sequences.
+ * @param letters the letters.
+ * @param len number of letters.
+ * @param open whether the last sequence is still being read, set to true.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int appendLetters(SequenceSet *sequences, const char *letters, size_t len, bool *open);
+
+/**
+ * End the last sequence if it is open.
+ * @param sequences the sequences.
+ * @param open whether the last sequence is still being read, set to false.
+ */
+void endSequence(SequenceSet *sequences, bool *open);
+
+/**
+ * @param sequences the sequences.
+ * @param k index of a sequence.
+ * @return the k'th sequence.
+ */
+const char *sequenceAt(const SequenceSet *sequences, int k);
+
+/**
+ * Compare to given sequences and return its maximum sub sequence weight.
+ * Only the score is needed, so the kernel keeps just a few rows or anti-diagonals along the
+ * shorter sequence: memory is O(min(len1, len2)). Weights of an edit distance are scored by
+ * editDistance instead of the kernel.
+ * @param seq1 first sequence to compare
+ * @param seq2 second sequence to compare
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param kernel the implementation filling the table.
+ * @param workspace rows to fill, grown if too short.
+ * @param score the maximum weight of the best matching sub sequence. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int compareSequences(const char *seq1, const char *seq2,
+                     const int *match, const int *misMatch, const int *gap,
+                     const Kernel *kernel, DpWorkspace *workspace, int *score);
+
+/**
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @return true if a score is an edit distance times the gap: matches weigh 0, and mismatches
+ * the same as gaps, below 0.
+ */
+bool isEditDistance(const int *match, const int *misMatch, const int *gap);
+
+/**
+ * Edit distance of two sequences by Myers' bit-vector algorithm, with Hyyro's blocks for seq1
+ * longer than a word. A column of the table is kept as the bits of the differences between
+ * its cells, so a word of WORD_BITS cells is filled by a few logic operations.
+ * @param seq1 first sequence.
+ * @param len1 first sequence length, not the longer.
+ * @param seq2 second sequence.
+ * @param len2 second sequence length.
+ * @param workspace holds the bits, grown if too short.
+ * @param distance the edit distance. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int editDistance(const char *seq1, int len1, const char *seq2, int len2,
+                 DpWorkspace *workspace, int *distance);
+
+/**
+ * Move a block of a column of the edit distance table to the next letter of seq2.
+ * @param plus bits of the cells 1 more than the cell above, set for the next column.
+ * @param minus bits of the cells 1 less than the cell above, set for the next column.
+ * @param matches bits of the letters of the block equal to the letter of seq2.
+ * @param carry the cell above the block less the one on its left: -1, 0 or 1.
+ * @param last the bit of the cell whose difference is returned.
+ * @return the cell of bit last less the one on its left.
+ */
+int advanceBlock(uint64_t *plus, uint64_t *minus, uint64_t matches, int carry, uint64_t last);
+
+/**
+ * Pick the kernel for an instruction set.
+ * @param name one of the KERNEL_ names. auto picks the best one supported by the CPU.
+ * @return the kernel, NULL if name is unknown or not supported by the CPU.
+ */
+const Kernel *selectKernel(const char *name);
+
+/**
+ * Scalar kernel, see Kernel: fills the table by rows with lastRow. The reference for the
+ * vector kernels.
+ */
+int scoreScalar(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score);
+
+/**
+ * Set up the workspace to fill the table of seq1 against seq2 by anti-diagonals, indexed by
+ * the letter of seq1. Diagonal d holds the cells i + j = d and is kept at diagonals[d % 3].
+ * @param seq2 second sequence.
+ * @param len1 first sequence length.
+ * @param len2 second sequence length.
+ * @param workspace the workspace.
+ * @param diagonals the three diagonals, diagonal 0 set. (output)
+ * @param reversed seq2 reversed, so cell i of diagonal d compares with reversed[len2 - d + i].
+ * (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int prepareDiagonals(const char *seq2, int len1, int len2, DpWorkspace *workspace,
+                     int *diagonals[SCORE_DIAGONALS], const char **reversed);
+
+/**
+ * Fill the cells from..to of diagonal d one by one, and its cells on the first row and column.
+ * @param seq1 first sequence.
+ * @param reversed second sequence reversed.
+ * @param len1 first sequence length.
+ * @param len2 second sequence length.
+ * @param d the diagonal.
+ * @param from first inner cell to fill.
+ * @param to last inner cell to fill.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param diagonals the three diagonals.
+ */
+void diagonalEdges(const char *seq1, const char *reversed, int len1, int len2, int d, int from,
+                   int to, const int *match, const int *misMatch, const int *gap,
+                   int *diagonals[SCORE_DIAGONALS]);
+#ifdef X86_KERNELS
+/**
+ * SSE4.1 kernel, see Kernel: fills anti-diagonals 4 cells at a time.
+ */
+int scoreSse(const char *seq1, int len1, const char *seq2, int len2,
+             const int *match, const int *misMatch, const int *gap,
+             DpWorkspace *workspace, int *score);
+/**
+ * AVX2 kernel, see Kernel: fills anti-diagonals 8 cells at a time.
+ */
+int scoreAvx2(const char *seq1, int len1, const char *seq2, int len2,
+              const int *match, const int *misMatch, const int *gap,
+              DpWorkspace *workspace, int *score);
+#endif
+
+/**
+ * Make sure the workspace holds rows of at least rowLen cells.
+ * @param workspace the workspace.
+ * @param rowLen cells needed in a row.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int reserveRows(DpWorkspace *workspace, int rowLen);
+
+/**
+ * Score a pair filling only the cells within band of the diagonal, widened to reach the last
+ * cell. The work is O(len * band), and the score is that of the best alignment staying in
+ * the band. An ADAPTIVE_BAND starts at BAND_START and doubles until no alignment leaving it
+ * can beat its score, so the score equals compareSequences.
+ * @param seq1 first sequence to compare
+ * @param seq2 second sequence to compare
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param band cells each side of the diagonal, or ADAPTIVE_BAND.
+ * @param workspace rows to fill, grown if too short.
+ * @param score the score of the pair. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int bandedScore(const char *seq1, const char *seq2,
+                const int *match, const int *misMatch, const int *gap, int band,
+                DpWorkspace *workspace, int *score);
+
+/**
+ * Fill the band of a table by rows. A row holds the cells of offsets -width..width from the
+ * diagonal, between two NO_SCORE cells.
+ * @param seq1 first sequence, not the longer.
+ * @param len1 seq1 length.
+ * @param seq2 second sequence.
+ * @param len2 seq2 length.
+ * @param width cells each side of the diagonal, at least len2 - len1.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param workspace rows to fill, grown if too short.
+ * @return the score of the last cell, or NO_SCORE if memory allocation failed.
+ */
+int bandRows(const char *seq1, int len1, const char *seq2, int len2, int width,
+             const int *match, const int *misMatch, const int *gap, DpWorkspace *workspace);
+
+/**
+ * Check that no alignment leaving a band can score more than the band's best. Leaving a band
+ * of width w and coming back takes at least 2(w + 1) - (len2 - len1) gaps, which bounds the
+ * letters such an alignment can match.
+ * @param len1 first sequence length, not the longer.
+ * @param len2 second sequence length.
+ * @param width cells each side of the diagonal.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param score the score of the band.
+ * @return true if score is the optimal score of the pair.
+ */
+bool bandIsOptimal(int len1, int len2, int width, const int *match, const int *misMatch,
+                   const int *gap, int score);
+
+/**
+ * Score a pair by rows, filling only the cells reachable from live cells of the row above.
+ * A cell scoring more than xDrop below the best score of the rows before it is dropped.
+ * Pairs whose last cell is dropped are scored in full by the kernel.
+ * @param seq1 first sequence to compare
+ * @param seq2 second sequence to compare
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param xDrop how far below the best score cells are dropped.
+ * @param kernel the kernel scoring pairs that drop their last cell.
+ * @param workspace rows to fill, grown if too short.
+ * @param score the score of the pair. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int xDropScore(const char *seq1, const char *seq2,
+               const int *match, const int *misMatch, const int *gap, int xDrop,
+               const Kernel *kernel, DpWorkspace *workspace, int *score);
+
+/**
+ * Set up the affine scoring asked by the options, if any: the matrix of options->matrixPath,
+ * or one of match and misMatch over the letters of the sequences.
+ * @param options the options, their scoring is set.
+ * @param sequences the sequences to score.
+ * @param match weight of match
+ * @param misMatch weight of mismatch
+ * @param gap weight of each letter of a gap.
+ * @param scoring the scoring, to be freed with freeScoring even upon failure. (output)
+ * @return 0 upon success, -1 if the matrix is invalid, misses letters of the sequences, or
+ * memory allocation failed.
+ */
+int initScoring(Options *options, const SequenceSet *sequences,
+                const int *match, const int *misMatch, const int *gap, Scoring *scoring);
+
+/**
+ * Read a substitution matrix: a line of the letters of the columns, then a line for each
+ * letter starting with it and holding its weights. Lines starting with MATRIX_COMMENT are
+ * skipped.
+ * @param path the matrix file.
+ * @param scoring its alphabet and matrix are set.
+ * @return 0 upon success, -1 if the matrix is invalid or memory allocation failed.
+ */
+int loadMatrix(const char *path, Scoring *scoring);
+
+/**
+ * Free the matrix of a scoring.
+ * @param scoring the scoring.
+ */
+void freeScoring(Scoring *scoring);
+
+/**
+ * Score a pair with a substitution matrix and affine gaps, by Gotoh's recurrence: the best
+ * score of each cell is kept along with the best ending in a gap in either sequence.
+ * @param seq1 first sequence to compare
+ * @param seq2 second sequence to compare
+ * @param scoring the weights.
+ * @param kernel the implementation filling the table.
+ * @param workspace rows to fill, grown if too short.
+ * @param score the score of the pair. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int affineScore(const char *seq1, const char *seq2, const Scoring *scoring,
+                const Kernel *kernel, DpWorkspace *workspace, int *score);
+
+/**
+ * Affine scalar kernel, see Kernel: fills the table by rows of seq1. The scores of each
+ * letter of the alphabet against seq1 are laid out first, so a cell reads its weight from the
+ * row of its seq2 letter.
+ */
+int affineScalar(const char *seq1, int len1, const char *seq2, int len2,
+                 const Scoring *scoring, DpWorkspace *workspace, int *score);
+
+/**
+ * Set up the workspace to fill the affine table of seq1 against seq2 by anti-diagonals, as
+ * prepareDiagonals does.
+ * @param seq1 first sequence.
+ * @param len1 first sequence length.
+ * @param seq2 second sequence.
+ * @param len2 second sequence length.
+ * @param scoring the weights.
+ * @param workspace the workspace.
+ * @param diagonals the diagonals, diagonal 0 set. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int prepareAffine(const char *seq1, int len1, const char *seq2, int len2,
+                  const Scoring *scoring, DpWorkspace *workspace, AffineDiagonals *diagonals);
+
+/**
+ * Fill the cells from..to of affine diagonal d one by one, and its cells on the first row and
+ * column.
+ * @param len1 first sequence length.
+ * @param len2 second sequence length.
+ * @param d the diagonal.
+ * @param from first inner cell to fill.
+ * @param to last inner cell to fill.
+ * @param scoring the weights.
+ * @param diagonals the diagonals.
+ */
+void affineEdges(int len1, int len2, int d, int from, int to, const Scoring *scoring,
+                 AffineDiagonals *diagonals);
+
+/**
+ * Make sure the workspace holds at least len letters.
+ * @param workspace the workspace.
+ * @param len letters needed.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int reserveLetters(DpWorkspace *workspace, int len);
+#ifdef X86_KERNELS
+/**
+ * Affine SSE4.1 kernel, see Kernel: fills anti-diagonals 4 cells at a time.
+ */
+int affineSse(const char *seq1, int len1, const char *seq2, int len2,
+              const Scoring *scoring, DpWorkspace *workspace, int *score);
+/**
+ * Affine AVX2 kernel, see Kernel: fills anti-diagonals 8 cells at a time, gathering their
+ * weights from the matrix.
+ */
+int affineAvx2(const char *seq1, int len1, const char *seq2, int len2,
+               const Scoring *scoring, DpWorkspace *workspace, int *score);
+#endif
+
+/**
+ * Score the best local alignment of a pair: the best alignment of any part of seq1 to any part
+ * of seq2, where no cell of the table falls below 0.
+ * @param seq1 first sequence to compare
+ * @param seq2 second sequence to compare
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param kernel the implementation filling the table.
+ * @param workspace rows to fill, grown if too short.
+ * @param score the score of the best local alignment. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int localScore(const char *seq1, const char *seq2,
+               const int *match, const int *misMatch, const int *gap,
+               const Kernel *kernel, DpWorkspace *workspace, int *score);
+
+/**
+ * Local scalar kernel, see Kernel: fills the table by rows of seq1, keeping the best cell.
+ * The reference for the striped kernels, and the kernel of gaps of positive weight.
+ */
+int localScalar(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score);
+
+/**
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @return the bias making both weights at least 0.
+ */
+long long weightBias(const int *match, const int *misMatch);
+
+/**
+ * Check that a striped pass of unsigned lanes up to limit can score with the weights.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap, not above 0.
+ * @param limit largest value of a lane.
+ * @return true if the biased weights and the gap fit the lanes.
+ */
+bool lanesFit(const int *match, const int *misMatch, const int *gap, int limit);
+
+/**
+ * Set up the workspace for a striped pass: the weights of seq1 against each letter of seq2 in
+ * the striped layout, and a column of scores of 0 before seq2.
+ * @param seq1 first sequence.
+ * @param len1 first sequence length.
+ * @param seq2 second sequence.
+ * @param len2 second sequence length.
+ * @param vectorBytes bytes of a vector.
+ * @param laneBytes bytes of a lane: 1, 2 or 4.
+ * @param bias added to the weights. Lanes past the end of seq1 weigh 0.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param workspace the workspace.
+ * @param profile the layout. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int prepareStriped(const char *seq1, int len1, const char *seq2, int len2, int vectorBytes,
+                   int laneBytes, int bias, const int *match, const int *misMatch,
+                   DpWorkspace *workspace, StripedProfile *profile);
+
+/**
+ * Make sure the workspace holds a profile of at least len ints.
+ * @param workspace the workspace.
+ * @param len ints needed.
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int reserveProfile(DpWorkspace *workspace, size_t len);
+#ifdef X86_KERNELS
+/**
+ * Local SSE4.1 kernel, see Kernel: Farrar's striped fill in saturating lanes of 8 bits, run
+ * again in 16 and then 32 bits only if the score overflows them.
+ */
+int localSse(const char *seq1, int len1, const char *seq2, int len2,
+             const int *match, const int *misMatch, const int *gap,
+             DpWorkspace *workspace, int *score);
+/**
+ * Striped passes of localSse in lanes of 8, 16 and 32 bits, see Kernel. The 8 and 16 bits
+ * passes return LANES_OVERFLOW if the score may not fit their lanes.
+ */
+int stripedSse8(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score);
+int stripedSse16(const char *seq1, int len1, const char *seq2, int len2,
+                 const int *match, const int *misMatch, const int *gap,
+                 DpWorkspace *workspace, int *score);
+int stripedSse32(const char *seq1, int len1, const char *seq2, int len2,
+                 const int *match, const int *misMatch, const int *gap,
+                 DpWorkspace *workspace, int *score);
+/**
+ * Local AVX2 kernel, see Kernel: localSse on vectors twice as wide.
+ */
+int localAvx2(const char *seq1, int len1, const char *seq2, int len2,
+              const int *match, const int *misMatch, const int *gap,
+              DpWorkspace *workspace, int *score);
+/**
+ * Striped passes of localAvx2, as those of localSse.
+ */
+int stripedAvx2x8(const char *seq1, int len1, const char *seq2, int len2,
+                  const int *match, const int *misMatch, const int *gap,
+                  DpWorkspace *workspace, int *score);
+int stripedAvx2x16(const char *seq1, int len1, const char *seq2, int len2,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace, int *score);
+int stripedAvx2x32(const char *seq1, int len1, const char *seq2, int len2,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace, int *score);
+/**
+ * Move the lanes of 8, 16 or 32 bits of an AVX2 vector up by one, across its halves.
+ * @param v the vector.
+ * @return v with lane k + 1 set to lane k of v, and 0 in lane 0.
+ */
+__m256i shiftAvx2x8(__m256i v);
+__m256i shiftAvx2x16(__m256i v);
+__m256i shiftAvx2x32(__m256i v);
+#endif
+
+/**
+ * Fill the score table of seq1 against seq2 row by row, a row for each letter of seq1.
+ * Letter i of a sequence is read at seq[i * step].
+ * @param seq1 first sequence.
+ * @param len1 seq1 length.
+ * @param seq2 second sequence.
+ * @param len2 seq2 length.
+ * @param step 1 to read forward, or -1 to read backward from seq1 and seq2, which then point
+ * to the last letters.
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param workspace rows to fill, grown if too short.
+ * @return the last row: len2 + 1 scores of all of seq1 against each prefix of seq2, or NULL if
+ * memory allocation failed.
+ */
+const int *lastRow(const char *seq1, int len1, const char *seq2, int len2, int step,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace);
+
+/**
+ * Align two sequences in linear memory with Hirschberg's recursion.
+ * @param seq1 first sequence to align
+ * @param seq2 second sequence to align
+ * @param match the weight of matching letters
+ * @param misMatch the weight of mis match
+ * @param gap the weight of gap
+ * @param threads threads sharing the recursion.
+ * @param alignment an optimal alignment, its ops to be freed by the caller. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int alignSequences(const char *seq1, const char *seq2,
+                   const int *match, const int *misMatch, const int *gap, int threads,
+                   Alignment *alignment);
+
+/**
+ * Align the subproblem of a task: split seq1 in half, find where an optimal alignment crosses
+ * the middle from a forward and a backward last row, and recurse on both sides.
+ * @param task the subproblem, its outputs are set.
+ */
+void hirschberg(AlignTask *task);
+
+/**
+ * Align a small subproblem with a full score table and its traceback.
+ * @param task the subproblem, its outputs are set.
+ */
+void alignTable(AlignTask *task);
+
+/**
+ * Thread entry computing the row of a RowTask.
+ * @param arg the RowTask.
+ * @return NULL.
+ */
+void *rowWorker(void *arg);
+
+/**
+ * Thread entry aligning an AlignTask.
+ * @param arg the AlignTask.
+ * @return NULL.
+ */
+void *alignWorker(void *arg);
+
+/**
+ * Run a worker on two arguments, the second on a new thread when parallel.
+ * If no thread can be created both are run on this one.
+ * @param worker thread entry.
+ * @param first argument of the worker run on this thread.
+ * @param second argument of the other worker.
+ * @param parallel whether to use a second thread.
+ */
+void runPair(void *(*worker)(void *), void *first, void *second, bool parallel);
+
+/**
+ * Print the alignment of a pair in the given format.
+ * @param seq1 first sequence aligned.
+ * @param seq2 second sequence aligned.
+ * @param alignment their alignment.
+ * @param format text or cigar.
+ */
+void printAlignment(const char *seq1, const char *seq2, const Alignment *alignment,
+                    enum AlignOutput format);
+
+/**
+ * Parse the options following the weights.
+ * @param argc number of arguments.
+ * @param argv arguments.
+ * @param options the parsed options. (output)
+ * @return 0 upon success, -1 if an option is invalid.
+ */
+int parseOptions(int argc, char *argv[], Options *options);
+
+/**
+ * @param arg command line argument.
+ * @param option option name, up to and including '='.
+ * @return the value following the option name, or NULL if arg is another option.
+ */
+const char *optionValue(const char *arg, const char *option);
+
+/**
+ * Compare all sequences pointed by sequences param. for each comparison it prints
+ * its maximum sub sequence match.
+ * @param sequences the sequences to be analized.
+ * @param match weight of match
+ * @param misMatch weight of mismatch
+ * @param gap weight of gap
+ * @param options how to score and print the alignments.
+ */
+void analyzeSequences(const SequenceSet *sequences,
+                      const int *match, const int *misMatch, const int *gap,
+                      const Options *options);
+
+/**
+ * Score all pairs one at a time, in SCORE_MSG order.
+ * @param sequences the sequences.
+ * @param match weight of match
+ * @param misMatch weight of mismatch
+ * @param gap weight of gap
+ * @param options how to score and print the alignments.
+ * @param sketches sketches of the prefilter, NULL to score all pairs.
+ */
+void analyzeSerial(const SequenceSet *sequences,
+                   const int *match, const int *misMatch, const int *gap,
+                   const Options *options, const SketchSet *sketches);
+
+/**
+ * Sketch every sequence once for the prefilter.
+ * @param sequences the sequences.
+ * @param kmer letters of a k-mer.
+ * @param sketches the sketches, to be freed with freeSketches even upon failure. (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int buildSketches(const SequenceSet *sequences, int kmer, SketchSet *sketches);
+
+/**
+ * Free the sketches.
+ * @param sketches the sketches.
+ */
+void freeSketches(SketchSet *sketches);
+
+/**
+ * Scramble the rolling hash of a k-mer, so the smallest hashes are a uniform sample.
+ * @param hash the hash.
+ * @return the scrambled hash.
+ */
+uint64_t mixHash(uint64_t hash);
+
+/**
+ * qsort comparison of uint64_t, ascending.
+ */
+int lowerHash(const void *a, const void *b);
+
+/**
+ * Check a pair against the prefilter. The SKETCH_SIZE smallest hashes of the union of both
+ * sketches are a sample of the union of their k-mers, and those found in both sketches
+ * estimate the share of k-mers in both sequences.
+ * @param sketches the sketches, or NULL if not filtering.
+ * @param threshold least similarity of a pair scored, in percent.
+ * @param first index of the first sequence.
+ * @param second index of the second sequence.
+ * @param similarity the estimated similarity in percent. (output)
+ * @return true if the pair is to be skipped. Pairs with a sequence shorter than a k-mer are
+ * never skipped.
+ */
+bool pairSkipped(const SketchSet *sketches, int threshold, int first, int second,
+                 int *similarity);
+
+/**
+ * Score or align a pair as the options ask.
+ * @param seq1 first sequence.
+ * @param seq2 second sequence.
+ * @param match weight of match
+ * @param misMatch weight of mismatch
+ * @param gap weight of gap
+ * @param options the kernel and alignment format.
+ * @param threads threads aligning the pair.
+ * @param workspace rows of the kernel.
+ * @param score the score of the pair. (output)
+ * @param alignment the alignment of the pair if aligning, to be freed by the caller.
+ * (output)
+ * @return 0 upon success, -1 if memory allocation failed.
+ */
+int analyzePair(const char *seq1, const char *seq2,
+                const int *match, const int *misMatch, const int *gap, const Options *options,
+                int threads, DpWorkspace *workspace, int *score, Alignment *alignment);
+
+/**
+ * Score all pairs on options->threads threads, in blocks of rows of about PAIR_BLOCK pairs.
+ * The pairs of a block are dealt longest first to per thread deques and idle threads steal
+ * from the others. The results of a block are printed in SCORE_MSG order and freed once all
+ * are done, before the next block starts. Pairs skipped by the prefilter are not dealt.
+ * @param sequences the sequences.
+ * @param match weight of match
+ * @param misMatch weight of mismatch
+ * @param gap weight of gap
+ * @param options how to score and print the alignments.
+ * @param sketches sketches of the prefilter, NULL to score all pairs.
+ */
+void analyzeParallel(const SequenceSet *sequences,
+                     const int *match, const int *misMatch, const int *gap,
+                     const Options *options, const SketchSet *sketches);
+
+/**
+ * Score the pairs of a block of rows on the threads of a scheduler.
+ * @param scheduler the scheduler, with room for the jobs and results of the block.
+ * @param workers the threads, as many as scheduler->deques.
+ * @param jobs room for the jobs of the block.
+ * @param rowStart first row of the block.
+ * @param rowEnd row after the block.
+ * @param sketches sketches of the prefilter, NULL to score all pairs.
+ */
+void scoreBlock(PairScheduler *scheduler, PairWorker *workers, PairJob *jobs,
+                int rowStart, int rowEnd, const SketchSet *sketches);
+
+/**
+ * Print the results of a block of rows in SCORE_MSG order and free its alignments.
+ * @param scheduler the scheduler, with the results of the block.
+ * @param rowStart first row of the block.
+ * @param rowEnd row after the block.
+ * @return 0 upon success, -1 if a pair could not be scored.
+ */
+int printBlock(const PairScheduler *scheduler, int rowStart, int rowEnd);
+
+/**
+ * Thread entry scoring the jobs of its deque, then stealing from the others.
+ * @param arg the PairWorker.
+ * @return NULL.
+ */
+void *pairWorker(void *arg);
+
+/**
+ * Take the next job of a thread.
+ * @param scheduler the scheduler.
+ * @param id the thread's deque.
+ * @param job the job taken. (output)
+ * @return true if a job was taken, false if all deques are empty.
+ */
+bool takeJob(PairScheduler *scheduler, int id, PairJob *job);
+
+/**
+ * qsort comparison of PairJobs, longer first and in SCORE_MSG order among equals.
+ */
+int longerJob(const void *a, const void *b);
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < FIRST_OPTION)
+    {
+        fprintf(stderr, INV_ARG);
+        exit(EXIT_FAILURE);
+    }
+    FILE *file;
+    file = fopen(argv[1], READ_MODE);
+    if (file == NULL)
+    {
+        fprintf(stderr, OPEN_FILE_ERR);
+        exit(EXIT_FAILURE);
+    }
+    int match, misMatch, gap, retVal;
+    retVal = s2i(argv[2], &match);
+    if(retVal < 0)
+    {
+        fprintf(stderr, INVALID_INP);
+        exit(EXIT_FAILURE);
+    }
+    retVal = s2i(argv[3], &misMatch);
+    if(retVal < 0)
+    {
+        fprintf(stderr, INVALID_INP);
+        exit(EXIT_FAILURE);
+    }
+    retVal = s2i(argv[4], &gap);
+    if(retVal < 0)
+    {
+        fprintf(stderr, INVALID_INP);
+        exit(EXIT_FAILURE);
+    }
+    Options options;
+    if(parseOptions(argc, argv, &options) < 0)
+    {
+        fprintf(stderr, INV_ARG);
+        exit(EXIT_FAILURE);
+    }
+    SequenceSet sequences;
+    Scoring scoring;
+    scoring.matrix = NULL;
+    if(extractSequences(file, &sequences) == 0 &&
+       initScoring(&options, &sequences, &match, &misMatch, &gap, &scoring) == 0)
+    {
+        analyzeSequences(&sequences, &match, &misMatch, &gap, &options);
+    }
+    freeScoring(&scoring);
+    cleanUp(&sequences);
+    fclose(file);
+    return 0;
+}
+
+
+int extractSequences(FILE *file, SequenceSet *sequences)
+{
+    sequences->arena = (char*)malloc(INITIAL_ARENA * sizeof(char));
+    sequences->arenaLen = 0;
+    sequences->arenaCap = INITIAL_ARENA;
+    sequences->offsets = (size_t*)malloc(INITIAL_SEQUENCES * sizeof(size_t));
+    sequences->lens = (int*)malloc(INITIAL_SEQUENCES * sizeof(int));
+    sequences->count = 0;
+    sequences->cap = INITIAL_SEQUENCES;
+    char *block = (char*)malloc(READ_BLOCK * sizeof(char));
+    if(sequences->arena == NULL || sequences->offsets == NULL || sequences->lens == NULL ||
+       block == NULL)
+    {
+        free(block);
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    bool open = false;  // the letters of the next line go to the last sequence.
+    bool lineStart = true;
+    bool skipLine = false;  // in a header, or past the '\r' of a line.
+    size_t blockLen;
+    while((blockLen = fread(block, sizeof(char), READ_BLOCK, file)) > 0)
+    {
+        for(size_t k = 0; k < blockLen;)
+        {
+            if(block[k] == '\n')
+            {
+                if(lineStart)
+                {
+                    endSequence(sequences, &open);  // empty line.
+                }
+                lineStart = true;
+                skipLine = false;
+                k++;
+                continue;
+            }
+            if(skipLine)
+            {
+                k++;
+                continue;
+            }
+            if(block[k] == '\r' || (lineStart && block[k] == SEQUENCE_HEADER))
+            {
+                if(lineStart)
+                {
+                    endSequence(sequences, &open);  // sequence header, or an empty line.
+                }
+                lineStart = false;
+                skipLine = true;
+                k++;
+                continue;
+            }
+            // letters up to the end of the line, or of the block.
+            size_t end = k;
+            while(end < blockLen && block[end] != '\n' && block[end] != '\r')
+            {
+                end++;
+            }
+            if(appendLetters(sequences, block + k, end - k, &open) < 0)
+            {
+                free(block);
+                fprintf(stderr, MEM_FAULT);
+                return -1;
+            }
+            lineStart = false;
+            k = end;
+        }
+    }
+    endSequence(sequences, &open);
+    free(block);
+    if(sequences->count < 2)
+    {
+        fprintf(stderr, INV_SEQ);
+        return -1;
+    }
+    return 0;
+}
+
+
+int appendLetters(SequenceSet *sequences, const char *letters, size_t len, bool *open)
+{
+    if(!*open)
+    {
+        if(sequences->count == sequences->cap)
+        {
+            size_t *offsets = (size_t*)realloc(sequences->offsets,
+                                               2 * sequences->cap * sizeof(size_t));
+            if(offsets == NULL)
+            {
+                return -1;
+            }
+            sequences->offsets = offsets;
+            int *lens = (int*)realloc(sequences->lens, 2 * sequences->cap * sizeof(int));
+            if(lens == NULL)
+            {
+                return -1;
+            }
+            sequences->lens = lens;
+            sequences->cap *= 2;
+        }
+        sequences->offsets[sequences->count] = sequences->arenaLen;
+        sequences->lens[sequences->count] = 0;
+        sequences->count++;
+        *open = true;
+    }
+    // keep room for the '\0' ending the sequence.
+    if(sequences->arenaLen + len + 1 > sequences->arenaCap)
+    {
+        size_t cap = 2 * sequences->arenaCap;
+        while(sequences->arenaLen + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+        char *arena = (char*)realloc(sequences->arena, cap * sizeof(char));
+        if(arena == NULL)
+        {
+            return -1;
+        }
+        sequences->arena = arena;
+        sequences->arenaCap = cap;
+    }
+    memcpy(sequences->arena + sequences->arenaLen, letters, len * sizeof(char));
+    sequences->arenaLen += len;
+    sequences->lens[sequences->count - 1] += (int)len;
+    return 0;
+}
+
+
+void endSequence(SequenceSet *sequences, bool *open)
+{
+    if(*open)
+    {
+        sequences->arena[sequences->arenaLen++] = '\0';
+        *open = false;
+    }
+}
+
+
+const char *sequenceAt(const SequenceSet *sequences, int k)
+{
+    return sequences->arena + sequences->offsets[k];
+}
+
+
+int parseOptions(int argc, char *argv[], Options *options)
+{
+    options->align = noAlign;
+    options->threads = 1;
+    options->kernel = selectKernel(KERNEL_AUTO);
+    options->band = 0;
+    options->xDrop = 0;
+    options->matrixPath = NULL;
+    options->gapOpen = 0;
+    options->scoring = NULL;
+    options->local = false;
+    options->prefilter = 0;
+    options->kmer = KMER_DEFAULT;
+    for(int i = FIRST_OPTION; i < argc; i++)
+    {
+        const char *value = optionValue(argv[i], ALIGN_OPTION);
+        if(value != NULL && strcmp(value, ALIGN_TEXT) == 0)
+        {
+            options->align = textAlign;
+        }
+        else if(value != NULL && strcmp(value, ALIGN_CIGAR) == 0)
+        {
+            options->align = cigarAlign;
+        }
+        else if((value = optionValue(argv[i], THREADS_OPTION)) != NULL &&
+                s2i(value, &options->threads) == 0 && options->threads > 0)
+        {
+            continue;
+        }
+        else if((value = optionValue(argv[i], KERNEL_OPTION)) != NULL)
+        {
+            options->kernel = selectKernel(value);
+            if(options->kernel == NULL)
+            {
+                fprintf(stderr, KERNEL_ERR, value);
+                return -1;
+            }
+        }
+        else if((value = optionValue(argv[i], BAND_OPTION)) != NULL &&
+                strcmp(value, BAND_AUTO) == 0)
+        {
+            options->band = ADAPTIVE_BAND;
+        }
+        else if((value = optionValue(argv[i], BAND_OPTION)) != NULL &&
+                s2i(value, &options->band) == 0 && options->band > 0)
+        {
+            continue;
+        }
+        else if((value = optionValue(argv[i], XDROP_OPTION)) != NULL &&
+                s2i(value, &options->xDrop) == 0 && options->xDrop > 0)
+        {
+            continue;
+        }
+        else if((value = optionValue(argv[i], MATRIX_OPTION)) != NULL && *value != '\0')
+        {
+            options->matrixPath = value;
+        }
+        else if((value = optionValue(argv[i], GAP_OPEN_OPTION)) != NULL &&
+                s2i(value, &options->gapOpen) == 0)
+        {
+            continue;
+        }
+        else if(strcmp(argv[i], LOCAL_OPTION) == 0)
+        {
+            options->local = true;
+        }
+        else if((value = optionValue(argv[i], PREFILTER_OPTION)) != NULL &&
+                s2i(value, &options->prefilter) == 0 && options->prefilter > 0 &&
+                options->prefilter <= FULL_SIMILARITY)
+        {
+            continue;
+        }
+        else if((value = optionValue(argv[i], KMER_OPTION)) != NULL &&
+                s2i(value, &options->kmer) == 0 && options->kmer > 0)
+        {
+            continue;
+        }
+        else
+        {
+            fprintf(stderr, UNKNOWN_OPTION, argv[i]);
+            return -1;
+        }
+    }
+    bool affine = options->matrixPath != NULL || options->gapOpen != 0;
+    if((options->band != 0) + (options->xDrop != 0) + (options->align != noAlign) + affine +
+       options->local > 1)
+    {
+        fprintf(stderr, COMBINE_ERR);
+        return -1;
+    }
+    return 0;
+}
+
+
+const char *optionValue(const char *arg, const char *option)
+{
+    if(strncmp(arg, option, strlen(option)) == 0)
+    {
+        return arg + strlen(option);
+    }
+    return NULL;
+}
+
+
+void analyzeSequences(const SequenceSet *sequences,
+                      const int *match, const int *misMatch, const int *gap,
+                      const Options *options)
+{
+    SketchSet sketches = {NULL, NULL};
+    if(options->prefilter > 0 && buildSketches(sequences, options->kmer, &sketches) < 0)
+    {
+        freeSketches(&sketches);
+        return;
+    }
+    const SketchSet *filter = options->prefilter > 0 ? &sketches : NULL;
+    long long pairs = (long long)sequences->count * (sequences->count - 1) / 2;
+    if(options->threads > 1 && pairs > 1)
+    {
+        analyzeParallel(sequences, match, misMatch, gap, options, filter);
+    }
+    else
+    {
+        analyzeSerial(sequences, match, misMatch, gap, options, filter);
+    }
+    freeSketches(&sketches);
+}
+
+
+void analyzeSerial(const SequenceSet *sequences,
+                   const int *match, const int *misMatch, const int *gap,
+                   const Options *options, const SketchSet *sketches)
+{
+    int score;
+    int similarity;
+    DpWorkspace workspace = {NULL, 0, NULL, 0, NULL, 0};
+    for(int i = 0; i < sequences->count; i++)
+    {
+        for(int j = i + 1; j < sequences->count; j++)
+        {
+            if(pairSkipped(sketches, options->prefilter, i, j, &similarity))
+            {
+                printf(SKIP_MSG, i + 1, j + 1, similarity);
+                continue;
+            }
+            Alignment alignment = {NULL, 0, 0};
+            if(analyzePair(sequenceAt(sequences, i), sequenceAt(sequences, j), match, misMatch,
+                           gap, options,
+                           options->threads, &workspace, &score, &alignment) < 0)
+            {
+                free(workspace.rows);
+                free(workspace.letters);
+                free(workspace.profile);
+                return;
+            }
+            printf(SCORE_MSG, i + 1, j + 1, score);
+            if(alignment.ops != NULL)
+            {
+                printAlignment(sequenceAt(sequences, i), sequenceAt(sequences, j), &alignment,
+                               options->align);
+                free(alignment.ops);
+            }
+        }
+    }
+    free(workspace.rows);
+    free(workspace.letters);
+    free(workspace.profile);
+}
+
+
+int buildSketches(const SequenceSet *sequences, int kmer, SketchSet *sketches)
+{
+    int longest = 0;
+    for(int k = 0; k < sequences->count; k++)
+    {
+        longest = sequences->lens[k] > longest ? sequences->lens[k] : longest;
+    }
+    sketches->hashes = (uint64_t*)malloc((size_t)sequences->count * SKETCH_SIZE *
+                                         sizeof(uint64_t));
+    sketches->lens = (int*)malloc(sequences->count * sizeof(int));
+    uint64_t *kmers = (uint64_t*)malloc((longest + 1) * sizeof(uint64_t));
+    if(sketches->hashes == NULL || sketches->lens == NULL || kmers == NULL)
+    {
+        free(kmers);
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    // KMER_BASE to the power of kmer, to drop the first letter of a k-mer from its hash.
+    uint64_t dropped = 1;
+    for(int k = 0; k < kmer; k++)
+    {
+        dropped *= KMER_BASE;
+    }
+    for(int k = 0; k < sequences->count; k++)
+    {
+        const unsigned char *letters = (const unsigned char*)sequenceAt(sequences, k);
+        int kmersLen = 0;
+        uint64_t hash = 0;
+        for(int i = 0; i < sequences->lens[k]; i++)
+        {
+            hash = hash * KMER_BASE + letters[i];
+            if(i >= kmer)
+            {
+                hash -= dropped * letters[i - kmer];
+            }
+            if(i >= kmer - 1)
+            {
+                kmers[kmersLen++] = mixHash(hash);
+            }
+        }
+        qsort(kmers, kmersLen, sizeof(uint64_t), lowerHash);
+        uint64_t *sketch = sketches->hashes + (size_t)k * SKETCH_SIZE;
+        int len = 0;
+        for(int i = 0; i < kmersLen && len < SKETCH_SIZE; i++)
+        {
+            if(len == 0 || kmers[i] != sketch[len - 1])
+            {
+                sketch[len++] = kmers[i];
+            }
+        }
+        sketches->lens[k] = len;
+    }
+    free(kmers);
+    return 0;
+}
+
+
+void freeSketches(SketchSet *sketches)
+{
+    free(sketches->hashes);
+    free(sketches->lens);
+}
+
+
+uint64_t mixHash(uint64_t hash)
+{
+    // the finalizer of MurmurHash3.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+int lowerHash(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+bool pairSkipped(const SketchSet *sketches, int threshold, int first, int second,
+                 int *similarity)
+{
+    if(sketches == NULL || sketches->lens[first] == 0 || sketches->lens[second] == 0)
+    {
+        return false;
+    }
+    const uint64_t *hashes1 = sketches->hashes + (size_t)first * SKETCH_SIZE;
+    const uint64_t *hashes2 = sketches->hashes + (size_t)second * SKETCH_SIZE;
+    int len1 = sketches->lens[first];
+    int len2 = sketches->lens[second];
+    int i = 0, j = 0, sampled = 0, shared = 0;
+    // merge the smallest hashes of the union.
+    for(; sampled < SKETCH_SIZE && (i < len1 || j < len2); sampled++)
+    {
+        if(i < len1 && j < len2 && hashes1[i] == hashes2[j])
+        {
+            shared++;
+            i++;
+            j++;
+        }
+        else if(j == len2 || (i < len1 && hashes1[i] < hashes2[j]))
+        {
+            i++;
+        }
+        else
+        {
+            j++;
+        }
+    }
+    *similarity = shared * FULL_SIMILARITY / sampled;
+    return *similarity < threshold;
+}
+
+
+int analyzePair(const char *seq1, const char *seq2,
+                const int *match, const int *misMatch, const int *gap, const Options *options,
+                int threads, DpWorkspace *workspace, int *score, Alignment *alignment)
+{
+    if(options->scoring != NULL)
+    {
+        return affineScore(seq1, seq2, options->scoring, options->kernel, workspace, score);
+    }
+    if(options->local)
+    {
+        return localScore(seq1, seq2, match, misMatch, gap, options->kernel, workspace, score);
+    }
+    if(options->band != 0)
+    {
+        return bandedScore(seq1, seq2, match, misMatch, gap, options->band, workspace, score);
+    }
+    if(options->xDrop > 0)
+    {
+        return xDropScore(seq1, seq2, match, misMatch, gap, options->xDrop, options->kernel,
+                          workspace, score);
+    }
+    if(options->align == noAlign)
+    {
+        return compareSequences(seq1, seq2, match, misMatch, gap, options->kernel, workspace,
+                                score);
+    }
+    if(alignSequences(seq1, seq2, match, misMatch, gap, threads, alignment) < 0)
+    {
+        return -1;
+    }
+    *score = alignment->score;
+    return 0;
+}
+
+
+void analyzeParallel(const SequenceSet *sequences,
+                     const int *match, const int *misMatch, const int *gap,
+                     const Options *options, const SketchSet *sketches)
+{
+    int count = sequences->count;
+    // a block ends at the row reaching PAIR_BLOCK pairs, so it may exceed it by a row.
+    int blockCap = PAIR_BLOCK + count;
+    int threads = options->threads;
+    PairJob *jobs = (PairJob*)malloc(blockCap * sizeof(PairJob));
+    int *scores = (int*)malloc(blockCap * sizeof(int));
+    signed char *states = (signed char*)malloc(blockCap * sizeof(signed char));
+    Alignment *alignments = options->align == noAlign ? NULL :
+                            (Alignment*)malloc(blockCap * sizeof(Alignment));
+    JobDeque *deques = (JobDeque*)malloc(threads * sizeof(JobDeque));
+    PairWorker *workers = (PairWorker*)malloc(threads * sizeof(PairWorker));
+    if(jobs == NULL || scores == NULL || states == NULL || deques == NULL ||
+       workers == NULL || (options->align != noAlign && alignments == NULL))
+    {
+        fprintf(stderr, MEM_FAULT);
+        free(jobs);
+        free(scores);
+        free(states);
+        free(alignments);
+        free(deques);
+        free(workers);
+        return;
+    }
+    PairScheduler scheduler = {sequences, match, misMatch, gap, options, deques, threads,
+                               scores, states, alignments};
+    for(int t = 0; t < threads; t++)
+    {
+        pthread_mutex_init(&deques[t].lock, NULL);
+        workers[t].scheduler = &scheduler;
+        workers[t].id = t;
+        workers[t].workspace = (DpWorkspace){NULL, 0, NULL, 0, NULL, 0};
+    }
+    for(int rowStart = 0, rowEnd; rowStart < count - 1; rowStart = rowEnd)
+    {
+        long long blockPairs = 0;
+        for(rowEnd = rowStart; rowEnd < count - 1 && blockPairs < PAIR_BLOCK; rowEnd++)
+        {
+            blockPairs += count - 1 - rowEnd;
+        }
+        scoreBlock(&scheduler, workers, jobs, rowStart, rowEnd, sketches);
+        if(printBlock(&scheduler, rowStart, rowEnd) < 0)
+        {
+            break;
+        }
+    }
+    for(int t = 0; t < options->threads; t++)
+    {
+        pthread_mutex_destroy(&deques[t].lock);
+        free(workers[t].workspace.rows);
+        free(workers[t].workspace.letters);
+        free(workers[t].workspace.profile);
+    }
+    free(jobs);
+    free(scores);
+    free(states);
+    free(alignments);
+    free(deques);
+    free(workers);
+}
+
+
+void scoreBlock(PairScheduler *scheduler, PairWorker *workers, PairJob *jobs,
+                int rowStart, int rowEnd, const SketchSet *sketches)
+{
+    const SequenceSet *sequences = scheduler->sequences;
+    const int *lens = sequences->lens;
+    int count = sequences->count;
+    int index = 0;
+    int jobsLen = 0;
+    for(int i = rowStart; i < rowEnd; i++)
+    {
+        for(int j = i + 1; j < count; j++, index++)
+        {
+            scheduler->states[index] = failedPair;
+            if(scheduler->alignments != NULL)
+            {
+                scheduler->alignments[index] = (Alignment){NULL, 0, 0};
+            }
+            if(pairSkipped(sketches, scheduler->options->prefilter, i, j,
+                           &scheduler->scores[index]))
+            {
+                scheduler->states[index] = skippedPair;
+            }
+            else
+            {
+                jobs[jobsLen++] = (PairJob){index, i, j,
+                                            ((long long)lens[i] + 1) * (lens[j] + 1)};
+            }
+        }
+    }
+    qsort(jobs, jobsLen, sizeof(PairJob), longerJob);
+    int threads = scheduler->options->threads;
+    if(jobsLen < threads)
+    {
+        threads = jobsLen > 0 ? jobsLen : 1;
+    }
+    scheduler->threads = threads;
+    // deal the jobs round robin, so each deque starts with a share of the longest ones.
+    for(int t = 0; t < threads; t++)
+    {
+        scheduler->deques[t].jobs = jobs + t;
+        scheduler->deques[t].stride = threads;
+        scheduler->deques[t].head = 0;
+        scheduler->deques[t].tail = t < jobsLen ? (jobsLen - t + threads - 1) / threads : 0;
+    }
+    // a worker that fails to start leaves its deque to be stolen by the others.
+    for(int t = 1; t < threads; t++)
+    {
+        workers[t].started = pthread_create(&workers[t].thread, NULL, pairWorker,
+                                            &workers[t]) == 0;
+    }
+    pairWorker(&workers[0]);
+    for(int t = 1; t < threads; t++)
+    {
+        if(workers[t].started)
+        {
+            pthread_join(workers[t].thread, NULL);
+        }
+    }
+}
+
+
+int printBlock(const PairScheduler *scheduler, int rowStart, int rowEnd)
+{
+    const SequenceSet *sequences = scheduler->sequences;
+    int count = sequences->count;
+    int index = 0;
+    int retVal = 0;
+    for(int i = rowStart; i < rowEnd; i++)
+    {
+        for(int j = i + 1; j < count; j++, index++)
+        {
+            Alignment *alignment = scheduler->alignments == NULL ? NULL :
+                                   &scheduler->alignments[index];
+            if(retVal == 0 && scheduler->states[index] == skippedPair)
+            {
+                printf(SKIP_MSG, i + 1, j + 1, scheduler->scores[index]);
+            }
+            else if(retVal == 0 && scheduler->states[index] == scoredPair)
+            {
+                printf(SCORE_MSG, i + 1, j + 1, scheduler->scores[index]);
+                if(alignment != NULL && alignment->ops != NULL)
+                {
+                    printAlignment(sequenceAt(sequences, i), sequenceAt(sequences, j),
+                                   alignment, scheduler->options->align);
+                }
+            }
+            else
+            {
+                retVal = -1;  // the rest of the block is only freed.
+            }
+            if(alignment != NULL)
+            {
+                free(alignment->ops);
+            }
+        }
+    }
+    return retVal;
+}
+
+
+void *pairWorker(void *arg)
+{
+    PairWorker *worker = (PairWorker*)arg;
+    PairScheduler *scheduler = worker->scheduler;
+    PairJob job;
+    while(takeJob(scheduler, worker->id, &job))
+    {
+        Alignment unused = {NULL, 0, 0};
+        Alignment *alignment = scheduler->alignments == NULL ? &unused :
+                               &scheduler->alignments[job.index];
+        if(analyzePair(sequenceAt(scheduler->sequences, job.first),
+                       sequenceAt(scheduler->sequences, job.second),
+                       scheduler->match, scheduler->misMatch, scheduler->gap,
+                       scheduler->options, 1, &worker->workspace,
+                       &scheduler->scores[job.index], alignment) == 0)
+        {
+            scheduler->states[job.index] = scoredPair;
+        }
+    }
+    return NULL;
+}
+
+
+bool takeJob(PairScheduler *scheduler, int id, PairJob *job)
+{
+    for(int k = 0; k < scheduler->threads; k++)
+    {
+        JobDeque *deque = &scheduler->deques[(id + k) % scheduler->threads];
+        bool taken = false;
+        pthread_mutex_lock(&deque->lock);
+        if(deque->head < deque->tail)
+        {
+            // the owner takes its longest job, a thief the shortest one left.
+            int position = k == 0 ? deque->head++ : --deque->tail;
+            *job = deque->jobs[(size_t)position * deque->stride];
+            taken = true;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if(taken)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int longerJob(const void *a, const void *b)
+{
+    const PairJob *jobA = (const PairJob*)a;
+    const PairJob *jobB = (const PairJob*)b;
+    if(jobA->cells != jobB->cells)
+    {
+        return jobA->cells > jobB->cells ? -1 : 1;
+    }
+    return jobA->index - jobB->index;
+}
+
+
+int compareSequences(const char *seq1, const char *seq2,
+                     const int *match, const int *misMatch, const int *gap,
+                     const Kernel *kernel, DpWorkspace *workspace, int *score)
+{
+    // the score is symmetric, so the rows run along the shorter sequence.
+    if(strlen(seq1) > strlen(seq2))
+    {
+        const char *longer = seq1;
+        seq1 = seq2;
+        seq2 = longer;
+    }
+    if(isEditDistance(match, misMatch, gap))
+    {
+        int distance;
+        if(editDistance(seq1, (int)strlen(seq1), seq2, (int)strlen(seq2), workspace,
+                        &distance) < 0)
+        {
+            fprintf(stderr, MEM_FAULT);
+            return -1;
+        }
+        *score = distance * *gap;
+        return 0;
+    }
+    if(kernel->score(seq1, (int)strlen(seq1), seq2, (int)strlen(seq2), match, misMatch, gap,
+                     workspace, score) < 0)
+    {
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    return 0;
+}
+
+
+bool isEditDistance(const int *match, const int *misMatch, const int *gap)
+{
+    return *match == 0 && *misMatch == *gap && *gap < 0;
+}
+
+
+int editDistance(const char *seq1, int len1, const char *seq2, int len2,
+                 DpWorkspace *workspace, int *distance)
+{
+    if(len1 == 0)
+    {
+        *distance = len2;
+        return 0;
+    }
+    unsigned char codes[UCHAR_MAX + 1];
+    int alphabetLen = 0;
+    memset(codes, NO_LETTER, sizeof(codes));
+    for(int j = 0; j < len2; j++)
+    {
+        if(codes[(unsigned char)seq2[j]] == NO_LETTER)
+        {
+            codes[(unsigned char)seq2[j]] = (unsigned char)alphabetLen++;
+        }
+    }
+    int blocks = (len1 + WORD_BITS - 1) / WORD_BITS;
+    size_t words = (size_t)(alphabetLen + 2) * blocks;
+    if(reserveProfile(workspace, words * sizeof(uint64_t) / sizeof(int)) < 0)
+    {
+        return -1;
+    }
+    // the bits of each letter of seq2 in seq1, then the plus and minus bits of the column.
+    uint64_t *matches = (uint64_t*)workspace->profile;
+    uint64_t *plus = matches + (size_t)alphabetLen * blocks;
+    uint64_t *minus = plus + blocks;
+    memset(matches, 0, (size_t)alphabetLen * blocks * sizeof(uint64_t));
+    for(int i = 0; i < len1; i++)
+    {
+        if(codes[(unsigned char)seq1[i]] != NO_LETTER)
+        {
+            matches[(size_t)codes[(unsigned char)seq1[i]] * blocks + i / WORD_BITS] |=
+                (uint64_t)1 << (i % WORD_BITS);
+        }
+    }
+    // the first column counts the letters of seq1: each cell is 1 more than the one above.
+    for(int b = 0; b < blocks; b++)
+    {
+        plus[b] = ~(uint64_t)0;
+        minus[b] = 0;
+    }
+    uint64_t last = (uint64_t)1 << ((len1 - 1) % WORD_BITS);
+    int cell = len1;  // the last cell of the column.
+    for(int j = 0; j < len2; j++)
+    {
+        const uint64_t *letterMatches = matches + (size_t)codes[(unsigned char)seq2[j]] * blocks;
+        int carry = 1;  // the first row counts the letters of seq2.
+        for(int b = 0; b < blocks - 1; b++)
+        {
+            carry = advanceBlock(&plus[b], &minus[b], letterMatches[b], carry, HIGH_BIT);
+        }
+        cell += advanceBlock(&plus[blocks - 1], &minus[blocks - 1], letterMatches[blocks - 1],
+                             carry, last);
+    }
+    *distance = cell;
+    return 0;
+}
+
+
+int advanceBlock(uint64_t *plus, uint64_t *minus, uint64_t matches, int carry, uint64_t last)
+{
+    uint64_t crossV = matches | *minus;
+    if(carry < 0)
+    {
+        matches |= 1;
+    }
+    uint64_t crossH = (((matches & *plus) + *plus) ^ *plus) | matches;
+    uint64_t plusH = *minus | ~(crossH | *plus);
+    uint64_t minusH = *plus & crossH;
+    int out = 0;
+    if(plusH & last)
+    {
+        out = 1;
+    }
+    else if(minusH & last)
+    {
+        out = -1;
+    }
+    plusH <<= 1;
+    minusH <<= 1;
+    if(carry < 0)
+    {
+        minusH |= 1;
+    }
+    else if(carry > 0)
+    {
+        plusH |= 1;
+    }
+    *plus = minusH | ~(crossV | plusH);
+    *minus = plusH & crossV;
+    return out;
+}
+
+
+const Kernel *selectKernel(const char *name)
+{
+    static const Kernel scalar = {KERNEL_SCALAR, scoreScalar, affineScalar, localScalar};
+#ifdef X86_KERNELS
+    static const Kernel sse = {KERNEL_SSE, scoreSse, affineSse, localSse};
+    static const Kernel avx2 = {KERNEL_AVX2, scoreAvx2, affineAvx2, localAvx2};
+    __builtin_cpu_init();
+    if((strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_AVX2) == 0) &&
+       __builtin_cpu_supports("avx2"))
+    {
+        return &avx2;
+    }
+    if((strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_SSE) == 0) &&
+       __builtin_cpu_supports("sse4.1"))
+    {
+        return &sse;
+    }
+#endif
+    if(strcmp(name, KERNEL_AUTO) == 0 || strcmp(name, KERNEL_SCALAR) == 0)
+    {
+        return &scalar;
+    }
+    return NULL;
+}
+
+
+int scoreScalar(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score)
+{
+    const int *row = lastRow(seq2, len2, seq1, len1, 1, match, misMatch, gap, workspace);
+    if(row == NULL)
+    {
+        return -1;
+    }
+    *score = row[len1];
+    return 0;
+}
+
+
+int prepareDiagonals(const char *seq2, int len1, int len2, DpWorkspace *workspace,
+                     int *diagonals[SCORE_DIAGONALS], const char **reversed)
+{
+    if(reserveRows(workspace, len1 + 1) < 0 || reserveLetters(workspace, len2) < 0)
+    {
+        return -1;
+    }
+    for(int k = 0; k < len2; k++)
+    {
+        workspace->letters[k] = seq2[len2 - 1 - k];
+    }
+    for(int k = 0; k < SCORE_DIAGONALS; k++)
+    {
+        diagonals[k] = workspace->rows + k * workspace->rowCap;
+    }
+    diagonals[0][0] = 0;
+    *reversed = workspace->letters;
+    return 0;
+}
+
+
+void diagonalEdges(const char *seq1, const char *reversed, int len1, int len2, int d, int from,
+                   int to, const int *match, const int *misMatch, const int *gap,
+                   int *diagonals[SCORE_DIAGONALS])
+{
+    int *current = diagonals[d % SCORE_DIAGONALS];
+    const int *previous = diagonals[(d + 2) % SCORE_DIAGONALS];
+    const int *before = diagonals[(d + 1) % SCORE_DIAGONALS];
+    for(int i = from; i <= to; i++)
+    {
+        int up = previous[i - 1] + (*gap);
+        int left = previous[i] + (*gap);
+        int corner = before[i - 1] +
+                     (seq1[i - 1] == reversed[len2 - d + i] ? *match : *misMatch);
+        current[i] = *myMax(&corner, myMax(&up, &left));
+    }
+    if(d <= len2)
+    {
+        current[0] = (*gap) * d;
+    }
+    if(d <= len1)
+    {
+        current[d] = (*gap) * d;
+    }
+}
+
+
+int bandedScore(const char *seq1, const char *seq2,
+                const int *match, const int *misMatch, const int *gap, int band,
+                DpWorkspace *workspace, int *score)
+{
+    if(strlen(seq1) > strlen(seq2))
+    {
+        const char *longer = seq1;
+        seq1 = seq2;
+        seq2 = longer;
+    }
+    int len1 = (int)strlen(seq1);
+    int len2 = (int)strlen(seq2);
+    int width = band == ADAPTIVE_BAND ? BAND_START : band;
+    if(width < len2 - len1)
+    {
+        width = len2 - len1;  // the last cell must be in the band.
+    }
+    while(true)
+    {
+        *score = bandRows(seq1, len1, seq2, len2, width, match, misMatch, gap, workspace);
+        if(*score == NO_SCORE)
+        {
+            fprintf(stderr, MEM_FAULT);
+            return -1;
+        }
+        // a band as wide as seq2 holds the whole table.
+        if(band != ADAPTIVE_BAND || width >= len2 ||
+           bandIsOptimal(len1, len2, width, match, misMatch, gap, *score))
+        {
+            return 0;
+        }
+        width = width > len2 / 2 ? len2 : 2 * width;
+    }
+}
+
+
+int bandRows(const char *seq1, int len1, const char *seq2, int len2, int width,
+             const int *match, const int *misMatch, const int *gap, DpWorkspace *workspace)
+{
+    // cell (i, j) is at index j - i + width + 1 of row i.
+    int rowLen = 2 * width + 3;
+    if(reserveRows(workspace, rowLen) < 0)
+    {
+        return NO_SCORE;
+    }
+    int *previous = workspace->rows;
+    int *current = workspace->rows + workspace->rowCap;
+    for(int k = 0; k < rowLen; k++)
+    {
+        int j = k - width - 1;
+        previous[k] = j >= 0 && j <= len2 ? (*gap) * j : NO_SCORE;
+    }
+    for(int i = 1; i <= len1; i++)
+    {
+        for(int k = 0; k < rowLen; k++)
+        {
+            current[k] = NO_SCORE;
+        }
+        int from = width + 1 - i > 1 ? width + 1 - i : 1;
+        int to = len2 - i + width + 1 < rowLen - 2 ? len2 - i + width + 1 : rowLen - 2;
+        if(from == width + 1 - i)
+        {
+            current[from++] = (*gap) * i;  // the first column.
+        }
+        for(int k = from; k <= to; k++)
+        {
+            int up = previous[k + 1] + (*gap);
+            int left = current[k - 1] + (*gap);
+            int corner = previous[k] +
+                         (seq1[i - 1] == seq2[i + k - width - 2] ? *match : *misMatch);
+            current[k] = *myMax(&corner, myMax(&up, &left));
+        }
+        int *filled = current;
+        current = previous;
+        previous = filled;
+    }
+    return previous[len2 - len1 + width + 1];
+}
+
+
+bool bandIsOptimal(int len1, int len2, int width, const int *match, const int *misMatch,
+                   const int *gap, int score)
+{
+    long long best = *match > *misMatch ? *match : *misMatch;
+    // a gap must cost more than half a letter pair, or leaving the band may always pay.
+    if(2LL * (*gap) >= best)
+    {
+        return false;
+    }
+    // with g gaps, (len1 + len2 - g) / 2 pairs of letters are aligned, at most len1.
+    long long gaps = 2LL * (width + 1) - (len2 - len1);
+    long long pairs = (len1 + len2 - gaps) / 2 < len1 ? (len1 + len2 - gaps) / 2 : len1;
+    long long outside = ((long long)len1 + len2) * (*gap) + pairs * (best - 2LL * (*gap));
+    return score >= outside;
+}
+
+
+int xDropScore(const char *seq1, const char *seq2,
+               const int *match, const int *misMatch, const int *gap, int xDrop,
+               const Kernel *kernel, DpWorkspace *workspace, int *score)
+{
+    if(strlen(seq1) > strlen(seq2))
+    {
+        const char *longer = seq1;
+        seq1 = seq2;
+        seq2 = longer;
+    }
+    int len1 = (int)strlen(seq1);
+    int len2 = (int)strlen(seq2);
+    if(reserveRows(workspace, len2 + 1) < 0)
+    {
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    int *previous = workspace->rows;
+    int *current = workspace->rows + workspace->rowCap;
+    // cells from..to of the previous row are live or NO_SCORE, the others were never filled.
+    int best = 0;
+    int from = 0;
+    int to = 0;
+    previous[0] = 0;
+    while(to < len2 && (*gap) * (to + 1) >= best - xDrop)
+    {
+        to++;
+        previous[to] = (*gap) * to;
+    }
+    for(int i = 1; i <= len1 && from <= to; i++)
+    {
+        int rowBest = NO_SCORE;
+        int liveFrom = -1;
+        int liveTo = -1;
+        for(int j = from; j <= len2; j++)
+        {
+            int cell = (*gap) * i;  // the first column.
+            if(j > 0)
+            {
+                int up = j <= to ? previous[j] + (*gap) : NO_SCORE;
+                int left = j > from ? current[j - 1] + (*gap) : NO_SCORE;
+                int corner = j - 1 >= from && j - 1 <= to ?
+                             previous[j - 1] + (seq1[i - 1] == seq2[j - 1] ? *match : *misMatch) :
+                             NO_SCORE;
+                cell = *myMax(&corner, myMax(&up, &left));
+            }
+            if(cell < best - xDrop)
+            {
+                current[j] = NO_SCORE;
+                if(j > to)
+                {
+                    break;  // past the row above only the cell to the left could reach here.
+                }
+                continue;
+            }
+            current[j] = cell;
+            liveFrom = liveFrom < 0 ? j : liveFrom;
+            liveTo = j;
+            rowBest = cell > rowBest ? cell : rowBest;
+        }
+        from = liveFrom < 0 ? 1 : liveFrom;
+        to = liveTo;
+        best = rowBest > best ? rowBest : best;
+        int *filled = current;
+        current = previous;
+        previous = filled;
+    }
+    if(from <= to && to == len2)
+    {
+        *score = previous[len2];
+        return 0;
+    }
+    return compareSequences(seq1, seq2, match, misMatch, gap, kernel, workspace, score);
+}
+
+
+int initScoring(Options *options, const SequenceSet *sequences,
+                const int *match, const int *misMatch, const int *gap, Scoring *scoring)
+{
+    if(options->matrixPath == NULL && options->gapOpen == 0)
+    {
+        return 0;
+    }
+    scoring->gapOpen = options->gapOpen;
+    scoring->gapExtend = *gap;
+    if(options->matrixPath != NULL)
+    {
+        if(loadMatrix(options->matrixPath, scoring) < 0)
+        {
+            return -1;
+        }
+        unsigned char any = scoring->codes[(unsigned char)MATRIX_ANY];
+        for(int letter = 0; letter <= UCHAR_MAX; letter++)
+        {
+            scoring->codes[letter] = scoring->codes[letter] == NO_LETTER ? any :
+                                     scoring->codes[letter];
+        }
+    }
+    else
+    {
+        // the alphabet is made of the letters of the sequences.
+        memset(scoring->codes, NO_LETTER, sizeof(scoring->codes));
+        scoring->alphabetLen = 0;
+        for(size_t k = 0; k < sequences->arenaLen; k++)
+        {
+            unsigned char letter = (unsigned char)sequences->arena[k];
+            if(letter != '\0' && scoring->codes[letter] == NO_LETTER)
+            {
+                scoring->codes[letter] = (unsigned char)scoring->alphabetLen++;
+            }
+        }
+        int alphabetLen = scoring->alphabetLen;
+        scoring->matrix = (int*)malloc((alphabetLen * alphabetLen + 1) * sizeof(int));
+        if(scoring->matrix == NULL)
+        {
+            fprintf(stderr, MEM_FAULT);
+            return -1;
+        }
+        for(int a = 0; a < alphabetLen; a++)
+        {
+            for(int b = 0; b < alphabetLen; b++)
+            {
+                scoring->matrix[a * alphabetLen + b] = a == b ? *match : *misMatch;
+            }
+        }
+    }
+    for(size_t k = 0; k < sequences->arenaLen; k++)
+    {
+        unsigned char letter = (unsigned char)sequences->arena[k];
+        if(letter != '\0' && scoring->codes[letter] == NO_LETTER)
+        {
+            fprintf(stderr, LETTER_ERR, letter);
+            return -1;
+        }
+    }
+    options->scoring = scoring;
+    return 0;
+}
+
+
+int loadMatrix(const char *path, Scoring *scoring)
+{
+    FILE *file = fopen(path, READ_MODE);
+    if(file == NULL)
+    {
+        fprintf(stderr, MATRIX_ERR, path);
+        return -1;
+    }
+    memset(scoring->codes, NO_LETTER, sizeof(scoring->codes));
+    scoring->alphabetLen = 0;
+    bool read[NO_LETTER] = {false};  // the rows read so far.
+    int rows = 0;
+    int retVal = 0;
+    char line[MATRIX_LINE];
+    while(retVal == 0 && fgets(line, MATRIX_LINE, file) != NULL)
+    {
+        char *token = strtok(line, MATRIX_SEPARATORS);
+        if(token == NULL || *token == MATRIX_COMMENT)
+        {
+            continue;
+        }
+        if(scoring->matrix == NULL)
+        {
+            // the header line: a letter for each column.
+            for(; token != NULL && retVal == 0; token = strtok(NULL, MATRIX_SEPARATORS))
+            {
+                unsigned char letter = (unsigned char)*token;
+                retVal = strlen(token) != 1 || scoring->codes[letter] != NO_LETTER ||
+                         scoring->alphabetLen == NO_LETTER ? -1 : 0;
+                scoring->codes[letter] = (unsigned char)scoring->alphabetLen++;
+            }
+            int alphabetLen = scoring->alphabetLen;
+            scoring->matrix = (int*)malloc(alphabetLen * alphabetLen * sizeof(int));
+            if(scoring->matrix == NULL)
+            {
+                fclose(file);
+                fprintf(stderr, MEM_FAULT);
+                return -1;
+            }
+            continue;
+        }
+        unsigned char row = scoring->codes[(unsigned char)*token];
+        if(strlen(token) != 1 || row == NO_LETTER || read[row])
+        {
+            retVal = -1;
+            break;
+        }
+        read[row] = true;
+        rows++;
+        for(int column = 0; column < scoring->alphabetLen && retVal == 0; column++)
+        {
+            token = strtok(NULL, MATRIX_SEPARATORS);
+            retVal = token == NULL ? -1 :
+                     s2i(token, &scoring->matrix[row * scoring->alphabetLen + column]);
+        }
+        retVal = strtok(NULL, MATRIX_SEPARATORS) != NULL ? -1 : retVal;
+    }
+    fclose(file);
+    retVal = rows == 0 || rows != scoring->alphabetLen ? -1 : retVal;
+    // the kernels may swap the sequences of a pair.
+    for(int a = 0; a < rows && retVal == 0; a++)
+    {
+        for(int b = 0; b < a && retVal == 0; b++)
+        {
+            retVal = scoring->matrix[a * rows + b] != scoring->matrix[b * rows + a] ? -1 : 0;
+        }
+    }
+    if(retVal < 0)
+    {
+        fprintf(stderr, MATRIX_ERR, path);
+    }
+    return retVal;
+}
+
+
+void freeScoring(Scoring *scoring)
+{
+    free(scoring->matrix);
+    scoring->matrix = NULL;
+}
+
+
+int affineScore(const char *seq1, const char *seq2, const Scoring *scoring,
+                const Kernel *kernel, DpWorkspace *workspace, int *score)
+{
+    if(strlen(seq1) > strlen(seq2))
+    {
+        const char *longer = seq1;
+        seq1 = seq2;
+        seq2 = longer;
+    }
+    if(kernel->affineScore(seq1, (int)strlen(seq1), seq2, (int)strlen(seq2), scoring, workspace,
+                           score) < 0)
+    {
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    return 0;
+}
+
+
+int affineScalar(const char *seq1, int len1, const char *seq2, int len2,
+                 const Scoring *scoring, DpWorkspace *workspace, int *score)
+{
+    int alphabetLen = scoring->alphabetLen;
+    size_t profileLen = (size_t)alphabetLen * len1;
+    if(reserveRows(workspace, len1 + 1) < 0 || reserveProfile(workspace, profileLen) < 0)
+    {
+        return -1;
+    }
+    for(int a = 0; a < alphabetLen; a++)
+    {
+        for(int j = 0; j < len1; j++)
+        {
+            workspace->profile[(size_t)a * len1 + j] =
+                scoring->matrix[a * alphabetLen + scoring->codes[(unsigned char)seq1[j]]];
+        }
+    }
+    int open = scoring->gapOpen + scoring->gapExtend;
+    int extend = scoring->gapExtend;
+    int *previous = workspace->rows;
+    int *current = workspace->rows + workspace->rowCap;
+    int *gaps1 = workspace->rows + 2 * workspace->rowCap;  // gaps in seq1 down to each cell.
+    previous[0] = 0;
+    for(int j = 1; j <= len1; j++)
+    {
+        previous[j] = scoring->gapOpen + extend * j;
+        gaps1[j] = NO_SCORE;
+    }
+    for(int i = 1; i <= len2; i++)
+    {
+        const int *weights = workspace->profile +
+                             (size_t)scoring->codes[(unsigned char)seq2[i - 1]] * len1;
+        int gap2 = NO_SCORE;  // gap in seq2 from the left.
+        current[0] = scoring->gapOpen + extend * i;
+        for(int j = 1; j <= len1; j++)
+        {
+            int opened = previous[j] + open;
+            int extended = gaps1[j] + extend;
+            gaps1[j] = *myMax(&opened, &extended);
+            opened = current[j - 1] + open;
+            extended = gap2 + extend;
+            gap2 = *myMax(&opened, &extended);
+            int corner = previous[j - 1] + weights[j - 1];
+            current[j] = *myMax(&corner, myMax(&gaps1[j], &gap2));
+        }
+        int *filled = current;
+        current = previous;
+        previous = filled;
+    }
+    *score = previous[len1];
+    return 0;
+}
+
+
+int prepareAffine(const char *seq1, int len1, const char *seq2, int len2,
+                  const Scoring *scoring, DpWorkspace *workspace, AffineDiagonals *diagonals)
+{
+    if(reserveRows(workspace, len1 + 1) < 0 || reserveLetters(workspace, len1 + len2) < 0)
+    {
+        return -1;
+    }
+    unsigned char *codes = (unsigned char*)workspace->letters;
+    for(int k = 0; k < len1; k++)
+    {
+        codes[k] = scoring->codes[(unsigned char)seq1[k]];
+    }
+    for(int k = 0; k < len2; k++)
+    {
+        codes[len1 + k] = scoring->codes[(unsigned char)seq2[len2 - 1 - k]];
+    }
+    diagonals->codes1 = codes;
+    diagonals->reversed = codes + len1;
+    int *row = workspace->rows;
+    for(int k = 0; k < SCORE_DIAGONALS; k++, row += workspace->rowCap)
+    {
+        diagonals->scores[k] = row;
+    }
+    for(int k = 0; k < GAP_DIAGONALS; k++, row += 2 * workspace->rowCap)
+    {
+        diagonals->gaps1[k] = row;
+        diagonals->gaps2[k] = row + workspace->rowCap;
+    }
+    diagonals->scores[0][0] = 0;
+    diagonals->gaps1[0][0] = NO_SCORE;
+    diagonals->gaps2[0][0] = NO_SCORE;
+    return 0;
+}
+
+
+void affineEdges(int len1, int len2, int d, int from, int to, const Scoring *scoring,
+                 AffineDiagonals *diagonals)
+{
+    int *scores = diagonals->scores[d % SCORE_DIAGONALS];
+    const int *previous = diagonals->scores[(d + 2) % SCORE_DIAGONALS];
+    const int *before = diagonals->scores[(d + 1) % SCORE_DIAGONALS];
+    int *gaps1 = diagonals->gaps1[d % GAP_DIAGONALS];
+    int *gaps2 = diagonals->gaps2[d % GAP_DIAGONALS];
+    const int *previousGaps1 = diagonals->gaps1[(d + 1) % GAP_DIAGONALS];
+    const int *previousGaps2 = diagonals->gaps2[(d + 1) % GAP_DIAGONALS];
+    int open = scoring->gapOpen + scoring->gapExtend;
+    int extend = scoring->gapExtend;
+    for(int i = from; i <= to; i++)
+    {
+        int opened = previous[i] + open;
+        int extended = previousGaps1[i] + extend;
+        gaps1[i] = *myMax(&opened, &extended);
+        opened = previous[i - 1] + open;
+        extended = previousGaps2[i - 1] + extend;
+        gaps2[i] = *myMax(&opened, &extended);
+        int corner = before[i - 1] +
+                     scoring->matrix[diagonals->codes1[i - 1] * scoring->alphabetLen +
+                                     diagonals->reversed[len2 - d + i]];
+        scores[i] = *myMax(&corner, myMax(&gaps1[i], &gaps2[i]));
+    }
+    if(d <= len2)
+    {
+        scores[0] = scoring->gapOpen + extend * d;
+        gaps1[0] = scores[0];
+        gaps2[0] = NO_SCORE;
+    }
+    if(d <= len1)
+    {
+        scores[d] = scoring->gapOpen + extend * d;
+        gaps1[d] = NO_SCORE;
+        gaps2[d] = scores[d];
+    }
+}
+
+
+int reserveLetters(DpWorkspace *workspace, int len)
+{
+    if(len <= workspace->lettersCap)
+    {
+        return 0;
+    }
+    char *letters = (char*)malloc(len * sizeof(char));
+    if(letters == NULL)
+    {
+        return -1;
+    }
+    free(workspace->letters);
+    workspace->letters = letters;
+    workspace->lettersCap = len;
+    return 0;
+}
+
+
+int localScore(const char *seq1, const char *seq2,
+               const int *match, const int *misMatch, const int *gap,
+               const Kernel *kernel, DpWorkspace *workspace, int *score)
+{
+    if(strlen(seq1) > strlen(seq2))
+    {
+        const char *longer = seq1;
+        seq1 = seq2;
+        seq2 = longer;
+    }
+    if(kernel->localScore(seq1, (int)strlen(seq1), seq2, (int)strlen(seq2), match, misMatch,
+                          gap, workspace, score) < 0)
+    {
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    return 0;
+}
+
+
+int localScalar(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score)
+{
+    if(reserveRows(workspace, len1 + 1) < 0)
+    {
+        return -1;
+    }
+    int *previous = workspace->rows;
+    int *current = workspace->rows + workspace->rowCap;
+    int zero = 0;
+    int best = 0;
+    for(int j = 0; j <= len1; j++)
+    {
+        previous[j] = 0;
+    }
+    for(int i = 1; i <= len2; i++)
+    {
+        current[0] = 0;
+        for(int j = 1; j <= len1; j++)
+        {
+            int corner = previous[j - 1] + (seq1[j - 1] == seq2[i - 1] ? *match : *misMatch);
+            int up = previous[j] + *gap;
+            int left = current[j - 1] + *gap;
+            current[j] = *myMax(&zero, myMax(&corner, myMax(&up, &left)));
+            best = *myMax(&best, &current[j]);
+        }
+        int *filled = current;
+        current = previous;
+        previous = filled;
+    }
+    *score = best;
+    return 0;
+}
+
+
+long long weightBias(const int *match, const int *misMatch)
+{
+    long long lowest = *match < *misMatch ? *match : *misMatch;
+    return lowest < 0 ? -lowest : 0;
+}
+
+
+bool lanesFit(const int *match, const int *misMatch, const int *gap, int limit)
+{
+    long long bias = weightBias(match, misMatch);
+    long long highest = (*match > *misMatch ? *match : *misMatch) + bias;
+    return bias < limit && highest < limit && -(long long)*gap <= limit;
+}
+
+
+int prepareStriped(const char *seq1, int len1, const char *seq2, int len2, int vectorBytes,
+                   int laneBytes, int bias, const int *match, const int *misMatch,
+                   DpWorkspace *workspace, StripedProfile *profile)
+{
+    int lanes = vectorBytes / laneBytes;
+    int segmentLen = len1 > 0 ? (len1 + lanes - 1) / lanes : 1;
+    int alphabetLen = 0;
+    memset(profile->codes, NO_LETTER, sizeof(profile->codes));
+    for(int j = 0; j < len2; j++)
+    {
+        if(profile->codes[(unsigned char)seq2[j]] == NO_LETTER)
+        {
+            profile->codes[(unsigned char)seq2[j]] = (unsigned char)alphabetLen++;
+        }
+    }
+    size_t columnBytes = (size_t)segmentLen * vectorBytes;
+    if(reserveProfile(workspace, (alphabetLen + 2) * columnBytes / sizeof(int)) < 0)
+    {
+        return -1;
+    }
+    unsigned char *weights = (unsigned char*)workspace->profile;
+    for(int letter = 0; letter <= UCHAR_MAX; letter++)
+    {
+        if(profile->codes[letter] == NO_LETTER)
+        {
+            continue;
+        }
+        unsigned char *column = weights + profile->codes[letter] * columnBytes;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            for(int lane = 0; lane < lanes; lane++)
+            {
+                int i = lane * segmentLen + k;
+                int weight = 0;
+                if(i < len1)
+                {
+                    weight = ((unsigned char)seq1[i] == letter ? *match : *misMatch) + bias;
+                }
+                size_t at = (size_t)k * lanes + lane;
+                if(laneBytes == sizeof(unsigned char))
+                {
+                    column[at] = (unsigned char)weight;
+                }
+                else if(laneBytes == sizeof(unsigned short))
+                {
+                    ((unsigned short*)column)[at] = (unsigned short)weight;
+                }
+                else
+                {
+                    ((int*)column)[at] = weight;
+                }
+            }
+        }
+    }
+    profile->weights = weights;
+    profile->columns[0] = weights + alphabetLen * columnBytes;
+    profile->columns[1] = weights + (alphabetLen + 1) * columnBytes;
+    memset(profile->columns[0], 0, columnBytes);
+    profile->segmentLen = segmentLen;
+    return 0;
+}
+
+
+int reserveProfile(DpWorkspace *workspace, size_t len)
+{
+    if(len <= workspace->profileCap)
+    {
+        return 0;
+    }
+    int *profile = (int*)malloc(len * sizeof(int));
+    if(profile == NULL)
+    {
+        return -1;
+    }
+    free(workspace->profile);
+    workspace->profile = profile;
+    workspace->profileCap = len;
+    return 0;
+}
+
+
+const int *lastRow(const char *seq1, int len1, const char *seq2, int len2, int step,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace)
+{
+    if(reserveRows(workspace, len2 + 1) < 0)
+    {
+        return NULL;
+    }
+    int *previous = workspace->rows;
+    int *current = workspace->rows + workspace->rowCap;
+    // table initialization: first row is set, and each row starts with its gaps.
+    for(int j = 0; j <= len2; j++)
+    {
+        previous[j] = (*gap) * j;
+    }
+    // main loop to fill the table. filling by rows, each from the one above it.
+    for(int i = 1; i <= len1; i++)
+    {
+        char letter = seq1[(i - 1) * step];
+        current[0] = (*gap) * i;
+        for(int j = 1; j <= len2; j++)
+        {
+            int up = previous[j] + (*gap);
+            int left = current[j - 1] + (*gap);
+            int corner = previous[j - 1] + (letter == seq2[(j - 1) * step] ? *match : *misMatch);
+            current[j] = *myMax(&corner, myMax(&up, &left));
+        }
+        int *filled = current;
+        current = previous;
+        previous = filled;
+    }
+    return previous;
+}
+
+
+int alignSequences(const char *seq1, const char *seq2,
+                   const int *match, const int *misMatch, const int *gap, int threads,
+                   Alignment *alignment)
+{
+    int len1 = (int)strlen(seq1);
+    int len2 = (int)strlen(seq2);
+    AlignTask task = {seq1, len1, seq2, len2, match, misMatch, gap, threads,
+                      (char*)malloc(((size_t)len1 + len2 + 1) * sizeof(char)), 0, 0};
+    if(task.ops != NULL)
+    {
+        hirschberg(&task);
+    }
+    if(task.ops == NULL || task.retVal < 0)
+    {
+        free(task.ops);
+        fprintf(stderr, MEM_FAULT);
+        return -1;
+    }
+    alignment->ops = task.ops;
+    alignment->opsLen = task.opsLen;
+    alignment->score = 0;
+    for(int k = 0, i = 0, j = 0; k < task.opsLen; k++)
+    {
+        if(task.ops[k] == MATCH_OP)
+        {
+            alignment->score += seq1[i++] == seq2[j++] ? *match : *misMatch;
+            continue;
+        }
+        i += task.ops[k] == DELETE_OP;
+        j += task.ops[k] == INSERT_OP;
+        alignment->score += *gap;
+    }
+    return 0;
+}
+
+
+void hirschberg(AlignTask *task)
+{
+    if(task->len1 < 2 || task->len2 < 2 ||
+       (size_t)(task->len1 + 1) * (size_t)(task->len2 + 1) <= BASE_CELLS)
+    {
+        alignTable(task);
+        return;
+    }
+    int mid = task->len1 / 2;
+    int len2 = task->len2;
+    RowTask forward = {task->seq1, mid, task->seq2, len2, 1,
+                       task->match, task->misMatch, task->gap, {NULL, 0, NULL, 0, NULL, 0}, NULL};
+    RowTask backward = {task->seq1 + task->len1 - 1, task->len1 - mid, task->seq2 + len2 - 1,
+                        len2, -1, task->match, task->misMatch, task->gap,
+                        {NULL, 0, NULL, 0, NULL, 0}, NULL};
+    runPair(rowWorker, &forward, &backward, task->threads > 1);
+    int split = 0;
+    if(forward.row != NULL && backward.row != NULL)
+    {
+        // an optimal alignment crosses the middle of seq1 where both halves score the most.
+        for(int k = 1; k <= len2; k++)
+        {
+            if(forward.row[k] + backward.row[len2 - k] >
+               forward.row[split] + backward.row[len2 - split])
+            {
+                split = k;
+            }
+        }
+    }
+    free(forward.workspace.rows);
+    free(backward.workspace.rows);
+    if(forward.row == NULL || backward.row == NULL)
+    {
+        task->retVal = -1;
+        return;
+    }
+    int leftThreads = task->threads / 2;
+    AlignTask left = {task->seq1, mid, task->seq2, split,
+                      task->match, task->misMatch, task->gap,
+                      leftThreads > 0 ? leftThreads : 1, task->ops, 0, 0};
+    AlignTask right = {task->seq1 + mid, task->len1 - mid, task->seq2 + split, len2 - split,
+                       task->match, task->misMatch, task->gap,
+                       task->threads - leftThreads, task->ops + mid + split, 0, 0};
+    runPair(alignWorker, &left, &right, task->threads > 1);
+    // the left side may be shorter than the room it was given.
+    memmove(task->ops + left.opsLen, right.ops, right.opsLen * sizeof(char));
+    task->opsLen = left.opsLen + right.opsLen;
+    task->retVal = left.retVal < 0 || right.retVal < 0 ? -1 : 0;
+}
+
 
+void alignTable(AlignTask *task)
+{
+    int rowLen = task->len2 + 1;
+    int *table = (int*)malloc((size_t)(task->len1 + 1) * rowLen * sizeof(int));
+    if(table == NULL)
+    {
+        task->retVal = -1;
+        return;
+    }
+    int gap = *task->gap;
+    for(int j = 0; j <= task->len2; j++)
+    {
+        table[j] = gap * j;
+    }
+    for(int i = 1; i <= task->len1; i++)
+    {
+        table[i * rowLen] = gap * i;
+        for(int j = 1; j <= task->len2; j++)
+        {
+            int up = table[(i - 1) * rowLen + j] + gap;
+            int left = table[i * rowLen + j - 1] + gap;
+            int corner = table[(i - 1) * rowLen + j - 1] +
+                         (task->seq1[i - 1] == task->seq2[j - 1] ? *task->match : *task->misMatch);
+            table[i * rowLen + j] = *myMax(&corner, myMax(&up, &left));
+        }
+    }
+    // trace back from the last cell, writing the operations from the end.
+    int i = task->len1;
+    int j = task->len2;
+    int k = task->len1 + task->len2;
+    while(i > 0 || j > 0)
+    {
+        int cell = table[i * rowLen + j];
+        if(i > 0 && j > 0 && cell == table[(i - 1) * rowLen + j - 1] +
+           (task->seq1[i - 1] == task->seq2[j - 1] ? *task->match : *task->misMatch))
+        {
+            task->ops[--k] = MATCH_OP;
+            i--;
+            j--;
+        }
+        else if(i > 0 && cell == table[(i - 1) * rowLen + j] + gap)
+        {
+            task->ops[--k] = DELETE_OP;
+            i--;
+        }
+        else
+        {
+            task->ops[--k] = INSERT_OP;
+            j--;
+        }
+    }
+    free(table);
+    task->opsLen = task->len1 + task->len2 - k;
+    memmove(task->ops, task->ops + k, task->opsLen * sizeof(char));
+    task->retVal = 0;
+}
 
-/**
- * @param x first integer
- * @param y second integer
- * @return * Return the pointer of the lerger integer. If x==y, y is returned.
- */
-const int *myMax(const int *x, const int *y);
 
-/**
- *
- * @param file pointer to a file to read from relevant sequences
- * @param sequences pointer to an array of pointers to be filled with read sequences.
- * fixed size of 100. (output)
- * @param sequencesRead number of sequences that are read from file to fill. (output)
- * @return
- */
-int extractSequences(FILE *file, char **sequences, int *sequencesRead);
+void *rowWorker(void *arg)
+{
+    RowTask *task = (RowTask*)arg;
+    task->row = lastRow(task->seq1, task->len1, task->seq2, task->len2, task->step,
+                        task->match, task->misMatch, task->gap, &task->workspace);
+    return NULL;
+}
 
-/**
- * Compare to given sequences and return its maximum sub sequence weight.
- * @param seq1 first sequence to compare
- * @param seq2 second sequence to compare
- * @param match the weight of matching letters
- * @param misMatch the weight of mis match
- * @param gap the weight of gap
- * @return the maximum weight of the best matching sub sequence.
- */
-int compareSequences(const char *seq1, const char *seq2,
-                     const int *match, const int *misMatch, const int *gap, int *score);
 
-/**
- * Compare all sequences pointed by sequences param. for each comparison it prints
- * its maximum sub sequence match.
- * @param sequences pointer to an array of addresses of the sequences to be analized.
- * @param sequencesRead number of sequences read. (sequences length)
- * @param match weight of match
- * @param misMatch weight of mismatch
- * @param gap weight of gap
- */
-void analyzeSequences(char** sequences, const int *sequencesRead,
-                      const int *match, const int *misMatch, const int *gap);
+void *alignWorker(void *arg)
+{
+    hirschberg((AlignTask*)arg);
+    return NULL;
+}
 
 
-int main(int argc, char* argv[])
+void runPair(void *(*worker)(void *), void *first, void *second, bool parallel)
 {
-    if (argc != 5)
+    pthread_t thread;
+    bool started = parallel && pthread_create(&thread, NULL, worker, second) == 0;
+    worker(first);
+    if(started)
     {
-        fprintf(stderr, INV_ARG);
-        exit(EXIT_FAILURE);
+        pthread_join(thread, NULL);
+        return;
     }
-    FILE *file;
-    file = fopen(argv[1], READ_MODE);
-    if (file == NULL)
+    worker(second);
+}
+
+
+void printAlignment(const char *seq1, const char *seq2, const Alignment *alignment,
+                    enum AlignOutput format)
+{
+    if(format == cigarAlign)
     {
-        fprintf(stderr, OPEN_FILE_ERR);
-        exit(EXIT_FAILURE);
+        for(int k = 0; k < alignment->opsLen;)
+        {
+            int run = k;
+            while(run < alignment->opsLen && alignment->ops[run] == alignment->ops[k])
+            {
+                run++;
+            }
+            printf(CIGAR_OP, run - k, alignment->ops[k]);
+            k = run;
+        }
+        putchar('\n');
+        return;
     }
-    int match, misMatch, gap, retVal;
-    retVal = s2i(argv[2], &match);
-    if(retVal < 0)
+    for(int k = 0; k < alignment->opsLen; k++)
     {
-        fprintf(stderr, INVALID_INP);
-        exit(EXIT_FAILURE);
+        putchar(alignment->ops[k] == INSERT_OP ? GAP_CHAR : *seq1++);
     }
-    retVal = s2i(argv[3], &misMatch);
-    if(retVal < 0)
+    putchar('\n');
+    for(int k = 0; k < alignment->opsLen; k++)
     {
-        fprintf(stderr, INVALID_INP);
-        exit(EXIT_FAILURE);
+        putchar(alignment->ops[k] == DELETE_OP ? GAP_CHAR : *seq2++);
     }
-    retVal = s2i(argv[4], &gap);
-    if(retVal < 0)
+    putchar('\n');
+}
+
+
+int reserveRows(DpWorkspace *workspace, int rowLen)
+{
+    if(rowLen <= workspace->rowCap)
     {
-        fprintf(stderr, INVALID_INP);
-        exit(EXIT_FAILURE);
+        return 0;
     }
-    int sequencesRead = 0;
-    char *sequences[MAX_SEQUENCES];
-    if(extractSequences(file, sequences, &sequencesRead) == 0)
+    int *rows = (int*)malloc(DP_ROWS * (size_t)rowLen * sizeof(int));
+    if(rows == NULL)
     {
-        analyzeSequences(sequences, &sequencesRead, &match, &misMatch, &gap);
+        return -1;
     }
-    cleanUp(sequences);
-    fclose(file);
+    free(workspace->rows);
+    workspace->rows = rows;
+    workspace->rowCap = rowLen;
     return 0;
 }
 
 
-int extractSequences(FILE *file, char **sequences, int *sequencesRead)
+#ifdef X86_KERNELS
+__attribute__((target("sse4.1")))
+int scoreSse(const char *seq1, int len1, const char *seq2, int len2,
+             const int *match, const int *misMatch, const int *gap,
+             DpWorkspace *workspace, int *score)
 {
-    char line[MAX_LINE + 1];  // +1 for end of string mark.
-    for(int i = 0; i < MAX_SEQUENCES; i++)
+    int *diagonals[SCORE_DIAGONALS];
+    const char *reversed;
+    if(prepareDiagonals(seq2, len1, len2, workspace, diagonals, &reversed) < 0)
     {
-        sequences[i] = NULL;
+        return -1;
     }
-    int linesOfSeq = 1;
-    char *seq = NULL;
-    char* token = NULL;
-    while(fgets(line, MAX_LINE + 1, file) != NULL && *sequencesRead < MAX_SEQUENCES)
+    __m128i matchV = _mm_set1_epi32(*match);
+    __m128i misMatchV = _mm_set1_epi32(*misMatch);
+    __m128i gapV = _mm_set1_epi32(*gap);
+    for(int d = 1; d <= len1 + len2; d++)
     {
-        // Sequence header
-        if (line[0] == SEQUENCE_HEADER)
+        int *current = diagonals[d % SCORE_DIAGONALS];
+        const int *previous = diagonals[(d + 2) % SCORE_DIAGONALS];
+        const int *before = diagonals[(d + 1) % SCORE_DIAGONALS];
+        // inner cells of the diagonal, off the first row and column.
+        int from = d - len2 > 1 ? d - len2 : 1;
+        int to = d - 1 < len1 ? d - 1 : len1;
+        int i = from;
+        for(; i + 3 <= to; i += 4)
         {
-            linesOfSeq = 1;
-            continue;
+            int letters1, letters2;
+            memcpy(&letters1, seq1 + i - 1, sizeof(int));
+            memcpy(&letters2, reversed + len2 - d + i, sizeof(int));
+            __m128i same = _mm_cmpeq_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(letters1)),
+                                           _mm_cvtepu8_epi32(_mm_cvtsi32_si128(letters2)));
+            __m128i corner = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(before + i - 1)),
+                                           _mm_blendv_epi8(misMatchV, matchV, same));
+            __m128i up = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previous + i - 1)),
+                                       gapV);
+            __m128i left = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previous + i)), gapV);
+            _mm_storeu_si128((__m128i*)(current + i),
+                             _mm_max_epi32(corner, _mm_max_epi32(up, left)));
         }
-        token = strtok(line, "\r\n");  // cut "\r\n"
-        // empty line.
-        if (token == NULL)
+        diagonalEdges(seq1, reversed, len1, len2, d, i, to, match, misMatch, gap, diagonals);
+    }
+    *score = diagonals[(len1 + len2) % SCORE_DIAGONALS][len1];
+    return 0;
+}
+
+
+__attribute__((target("avx2")))
+int scoreAvx2(const char *seq1, int len1, const char *seq2, int len2,
+              const int *match, const int *misMatch, const int *gap,
+              DpWorkspace *workspace, int *score)
+{
+    int *diagonals[SCORE_DIAGONALS];
+    const char *reversed;
+    if(prepareDiagonals(seq2, len1, len2, workspace, diagonals, &reversed) < 0)
+    {
+        return -1;
+    }
+    __m256i matchV = _mm256_set1_epi32(*match);
+    __m256i misMatchV = _mm256_set1_epi32(*misMatch);
+    __m256i gapV = _mm256_set1_epi32(*gap);
+    for(int d = 1; d <= len1 + len2; d++)
+    {
+        int *current = diagonals[d % SCORE_DIAGONALS];
+        const int *previous = diagonals[(d + 2) % SCORE_DIAGONALS];
+        const int *before = diagonals[(d + 1) % SCORE_DIAGONALS];
+        // inner cells of the diagonal, off the first row and column.
+        int from = d - len2 > 1 ? d - len2 : 1;
+        int to = d - 1 < len1 ? d - 1 : len1;
+        int i = from;
+        for(; i + 7 <= to; i += 8)
         {
-            linesOfSeq = 1;
-            continue;
+            __m256i letters1 = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(seq1 + i - 1)));
+            __m256i letters2 = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(reversed + len2 - d + i)));
+            __m256i corner = _mm256_add_epi32(
+                _mm256_loadu_si256((const __m256i*)(before + i - 1)),
+                _mm256_blendv_epi8(misMatchV, matchV, _mm256_cmpeq_epi32(letters1, letters2)));
+            __m256i up = _mm256_add_epi32(
+                _mm256_loadu_si256((const __m256i*)(previous + i - 1)), gapV);
+            __m256i left = _mm256_add_epi32(
+                _mm256_loadu_si256((const __m256i*)(previous + i)), gapV);
+            _mm256_storeu_si256((__m256i*)(current + i),
+                                _mm256_max_epi32(corner, _mm256_max_epi32(up, left)));
+        }
+        diagonalEdges(seq1, reversed, len1, len2, d, i, to, match, misMatch, gap, diagonals);
+    }
+    *score = diagonals[(len1 + len2) % SCORE_DIAGONALS][len1];
+    return 0;
+}
+
+
+__attribute__((target("sse4.1")))
+int affineSse(const char *seq1, int len1, const char *seq2, int len2,
+              const Scoring *scoring, DpWorkspace *workspace, int *score)
+{
+    AffineDiagonals diagonals;
+    if(prepareAffine(seq1, len1, seq2, len2, scoring, workspace, &diagonals) < 0)
+    {
+        return -1;
+    }
+    const int *matrix = scoring->matrix;
+    int alphabetLen = scoring->alphabetLen;
+    __m128i openV = _mm_set1_epi32(scoring->gapOpen + scoring->gapExtend);
+    __m128i extendV = _mm_set1_epi32(scoring->gapExtend);
+    for(int d = 1; d <= len1 + len2; d++)
+    {
+        int *scores = diagonals.scores[d % SCORE_DIAGONALS];
+        const int *previous = diagonals.scores[(d + 2) % SCORE_DIAGONALS];
+        const int *before = diagonals.scores[(d + 1) % SCORE_DIAGONALS];
+        int *gaps1 = diagonals.gaps1[d % GAP_DIAGONALS];
+        int *gaps2 = diagonals.gaps2[d % GAP_DIAGONALS];
+        const int *previousGaps1 = diagonals.gaps1[(d + 1) % GAP_DIAGONALS];
+        const int *previousGaps2 = diagonals.gaps2[(d + 1) % GAP_DIAGONALS];
+        const unsigned char *codes1 = diagonals.codes1;
+        const unsigned char *codes2 = diagonals.reversed + len2 - d;
+        // inner cells of the diagonal, off the first row and column.
+        int from = d - len2 > 1 ? d - len2 : 1;
+        int to = d - 1 < len1 ? d - 1 : len1;
+        int i = from;
+        for(; i + 3 <= to; i += 4)
+        {
+            __m128i weights = _mm_setr_epi32(
+                matrix[codes1[i - 1] * alphabetLen + codes2[i]],
+                matrix[codes1[i] * alphabetLen + codes2[i + 1]],
+                matrix[codes1[i + 1] * alphabetLen + codes2[i + 2]],
+                matrix[codes1[i + 2] * alphabetLen + codes2[i + 3]]);
+            __m128i gap1 = _mm_max_epi32(
+                _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previous + i)), openV),
+                _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previousGaps1 + i)), extendV));
+            __m128i gap2 = _mm_max_epi32(
+                _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previous + i - 1)), openV),
+                _mm_add_epi32(_mm_loadu_si128((const __m128i*)(previousGaps2 + i - 1)),
+                              extendV));
+            __m128i corner = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(before + i - 1)),
+                                           weights);
+            _mm_storeu_si128((__m128i*)(gaps1 + i), gap1);
+            _mm_storeu_si128((__m128i*)(gaps2 + i), gap2);
+            _mm_storeu_si128((__m128i*)(scores + i),
+                             _mm_max_epi32(corner, _mm_max_epi32(gap1, gap2)));
+        }
+        affineEdges(len1, len2, d, i, to, scoring, &diagonals);
+    }
+    *score = diagonals.scores[(len1 + len2) % SCORE_DIAGONALS][len1];
+    return 0;
+}
+
+
+__attribute__((target("avx2")))
+int affineAvx2(const char *seq1, int len1, const char *seq2, int len2,
+               const Scoring *scoring, DpWorkspace *workspace, int *score)
+{
+    AffineDiagonals diagonals;
+    if(prepareAffine(seq1, len1, seq2, len2, scoring, workspace, &diagonals) < 0)
+    {
+        return -1;
+    }
+    __m256i alphabetV = _mm256_set1_epi32(scoring->alphabetLen);
+    __m256i openV = _mm256_set1_epi32(scoring->gapOpen + scoring->gapExtend);
+    __m256i extendV = _mm256_set1_epi32(scoring->gapExtend);
+    for(int d = 1; d <= len1 + len2; d++)
+    {
+        int *scores = diagonals.scores[d % SCORE_DIAGONALS];
+        const int *previous = diagonals.scores[(d + 2) % SCORE_DIAGONALS];
+        const int *before = diagonals.scores[(d + 1) % SCORE_DIAGONALS];
+        int *gaps1 = diagonals.gaps1[d % GAP_DIAGONALS];
+        int *gaps2 = diagonals.gaps2[d % GAP_DIAGONALS];
+        const int *previousGaps1 = diagonals.gaps1[(d + 1) % GAP_DIAGONALS];
+        const int *previousGaps2 = diagonals.gaps2[(d + 1) % GAP_DIAGONALS];
+        // inner cells of the diagonal, off the first row and column.
+        int from = d - len2 > 1 ? d - len2 : 1;
+        int to = d - 1 < len1 ? d - 1 : len1;
+        int i = from;
+        for(; i + 7 <= to; i += 8)
+        {
+            __m256i codes1 = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(diagonals.codes1 + i - 1)));
+            __m256i codes2 = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(diagonals.reversed + len2 - d + i)));
+            __m256i weights = _mm256_i32gather_epi32(
+                scoring->matrix, _mm256_add_epi32(_mm256_mullo_epi32(codes1, alphabetV), codes2),
+                sizeof(int));
+            __m256i gap1 = _mm256_max_epi32(
+                _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(previous + i)), openV),
+                _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(previousGaps1 + i)),
+                                 extendV));
+            __m256i gap2 = _mm256_max_epi32(
+                _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(previous + i - 1)), openV),
+                _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(previousGaps2 + i - 1)),
+                                 extendV));
+            __m256i corner = _mm256_add_epi32(
+                _mm256_loadu_si256((const __m256i*)(before + i - 1)), weights);
+            _mm256_storeu_si256((__m256i*)(gaps1 + i), gap1);
+            _mm256_storeu_si256((__m256i*)(gaps2 + i), gap2);
+            _mm256_storeu_si256((__m256i*)(scores + i),
+                                _mm256_max_epi32(corner, _mm256_max_epi32(gap1, gap2)));
+        }
+        affineEdges(len1, len2, d, i, to, scoring, &diagonals);
+    }
+    *score = diagonals.scores[(len1 + len2) % SCORE_DIAGONALS][len1];
+    return 0;
+}
+
+
+__attribute__((target("sse4.1")))
+int localSse(const char *seq1, int len1, const char *seq2, int len2,
+             const int *match, const int *misMatch, const int *gap,
+             DpWorkspace *workspace, int *score)
+{
+    // the striped lanes stop their gaps once they can improve no cell, which needs a cost.
+    if(*gap > 0)
+    {
+        return localScalar(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    int retVal = LANES_OVERFLOW;
+    if(lanesFit(match, misMatch, gap, UCHAR_MAX))
+    {
+        retVal = stripedSse8(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    if(retVal == LANES_OVERFLOW && lanesFit(match, misMatch, gap, USHRT_MAX))
+    {
+        retVal = stripedSse16(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    if(retVal == LANES_OVERFLOW)
+    {
+        retVal = stripedSse32(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    return retVal;
+}
+
+
+__attribute__((target("sse4.1")))
+int stripedSse8(const char *seq1, int len1, const char *seq2, int len2,
+                const int *match, const int *misMatch, const int *gap,
+                DpWorkspace *workspace, int *score)
+{
+    int bias = (int)weightBias(match, misMatch);
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m128i), sizeof(unsigned char), bias,
+                      match, misMatch, workspace, &profile) < 0)
+    {
+        return -1;
+    }
+    int segmentLen = profile.segmentLen;
+    __m128i *before = (__m128i*)profile.columns[0];
+    __m128i *filled = (__m128i*)profile.columns[1];
+    __m128i zero = _mm_setzero_si128();
+    __m128i biasV = _mm_set1_epi8((char)bias);
+    __m128i gapV = _mm_set1_epi8((char)-*gap);
+    __m128i limitV = _mm_set1_epi8((char)(UCHAR_MAX - bias));  // scores from here may be cut.
+    __m128i best = zero;
+    for(int j = 0; j < len2; j++)
+    {
+        const __m128i *weights = (const __m128i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        // the first letter of a segment follows the last letter of the segment before.
+        __m128i corner = _mm_slli_si128(_mm_loadu_si128(before + segmentLen - 1), 1);
+        __m128i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m128i left = _mm_loadu_si128(before + k);
+            __m128i cell = _mm_subs_epu8(_mm_adds_epu8(corner, _mm_loadu_si128(weights + k)),
+                                         biasV);
+            cell = _mm_max_epu8(cell, _mm_max_epu8(_mm_subs_epu8(left, gapV), up));
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epu8(best, cell);
+            up = _mm_subs_epu8(cell, gapV);
+            corner = left;
         }
-        // Sequence consists of 2 lines or more.
-        if (linesOfSeq >= 2)
+        // carry the gaps down into the next segments until they improve no cell.
+        up = _mm_slli_si128(up, 1);
+        for(int k = 0; _mm_movemask_epi8(_mm_cmpeq_epi8(
+                           _mm_subs_epu8(up, _mm_loadu_si128(filled + k)), zero)) != 0xFFFF;)
         {
-            // Realloc memory of last inserted sequence
-            char* lastSeq = sequences[*(sequencesRead) - 1];
-            if (realloc(lastSeq, (strlen(token) + strlen(lastSeq)) * sizeof(char)) == NULL)
+            __m128i cell = _mm_max_epu8(_mm_loadu_si128(filled + k), up);
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epu8(best, cell);
+            up = _mm_subs_epu8(up, gapV);
+            if(++k == segmentLen)
             {
-                fprintf(stderr, MEM_FAULT);
-                return -1;
+                k = 0;
+                up = _mm_slli_si128(up, 1);
             }
-            strcat(lastSeq, token);
-            linesOfSeq++;
-            continue;
         }
-        // New sequence
-        seq = (char*)malloc(strlen(token) * sizeof(char));
-        if (seq == NULL)
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(best, limitV), best)) != 0)
         {
-            fprintf(stderr, MEM_FAULT);
-            return -1;
+            return LANES_OVERFLOW;
         }
-        strcpy(seq, token);
-        sequences[*sequencesRead] = seq;
-        (*sequencesRead)++;
-        linesOfSeq++;
+        __m128i *swap = before;
+        before = filled;
+        filled = swap;
     }
-    if(*sequencesRead < 2)
+    best = _mm_max_epu8(best, _mm_srli_si128(best, 8));
+    best = _mm_max_epu8(best, _mm_srli_si128(best, 4));
+    best = _mm_max_epu8(best, _mm_srli_si128(best, 2));
+    best = _mm_max_epu8(best, _mm_srli_si128(best, 1));
+    *score = _mm_extract_epi8(best, 0);
+    return 0;
+}
+
+
+__attribute__((target("sse4.1")))
+int stripedSse16(const char *seq1, int len1, const char *seq2, int len2,
+                 const int *match, const int *misMatch, const int *gap,
+                 DpWorkspace *workspace, int *score)
+{
+    int bias = (int)weightBias(match, misMatch);
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m128i), sizeof(unsigned short), bias,
+                      match, misMatch, workspace, &profile) < 0)
     {
-        fprintf(stderr, INV_SEQ);
         return -1;
     }
+    int segmentLen = profile.segmentLen;
+    __m128i *before = (__m128i*)profile.columns[0];
+    __m128i *filled = (__m128i*)profile.columns[1];
+    __m128i zero = _mm_setzero_si128();
+    __m128i biasV = _mm_set1_epi16((short)bias);
+    __m128i gapV = _mm_set1_epi16((short)-*gap);
+    __m128i limitV = _mm_set1_epi16((short)(USHRT_MAX - bias));
+    __m128i best = zero;
+    for(int j = 0; j < len2; j++)
+    {
+        const __m128i *weights = (const __m128i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        __m128i corner = _mm_slli_si128(_mm_loadu_si128(before + segmentLen - 1), 2);
+        __m128i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m128i left = _mm_loadu_si128(before + k);
+            __m128i cell = _mm_subs_epu16(_mm_adds_epu16(corner, _mm_loadu_si128(weights + k)),
+                                          biasV);
+            cell = _mm_max_epu16(cell, _mm_max_epu16(_mm_subs_epu16(left, gapV), up));
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epu16(best, cell);
+            up = _mm_subs_epu16(cell, gapV);
+            corner = left;
+        }
+        up = _mm_slli_si128(up, 2);
+        for(int k = 0; _mm_movemask_epi8(_mm_cmpeq_epi16(
+                           _mm_subs_epu16(up, _mm_loadu_si128(filled + k)), zero)) != 0xFFFF;)
+        {
+            __m128i cell = _mm_max_epu16(_mm_loadu_si128(filled + k), up);
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epu16(best, cell);
+            up = _mm_subs_epu16(up, gapV);
+            if(++k == segmentLen)
+            {
+                k = 0;
+                up = _mm_slli_si128(up, 2);
+            }
+        }
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_max_epu16(best, limitV), best)) != 0)
+        {
+            return LANES_OVERFLOW;
+        }
+        __m128i *swap = before;
+        before = filled;
+        filled = swap;
+    }
+    best = _mm_max_epu16(best, _mm_srli_si128(best, 8));
+    best = _mm_max_epu16(best, _mm_srli_si128(best, 4));
+    best = _mm_max_epu16(best, _mm_srli_si128(best, 2));
+    *score = _mm_extract_epi16(best, 0);
     return 0;
 }
 
 
-void analyzeSequences(char** sequences, const int *sequencesRead,
-                      const int *match, const int *misMatch, const int *gap)
+__attribute__((target("sse4.1")))
+int stripedSse32(const char *seq1, int len1, const char *seq2, int len2,
+                 const int *match, const int *misMatch, const int *gap,
+                 DpWorkspace *workspace, int *score)
 {
-    int score;
-    for(int i = 0; i < *sequencesRead; i++)
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m128i), sizeof(int), 0, match, misMatch,
+                      workspace, &profile) < 0)
+    {
+        return -1;
+    }
+    int segmentLen = profile.segmentLen;
+    __m128i *before = (__m128i*)profile.columns[0];
+    __m128i *filled = (__m128i*)profile.columns[1];
+    __m128i zero = _mm_setzero_si128();
+    __m128i gapV = _mm_set1_epi32(*gap);
+    __m128i best = zero;
+    for(int j = 0; j < len2; j++)
     {
-        for(int j = i + 1; j < *sequencesRead; j++)
+        const __m128i *weights = (const __m128i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        __m128i corner = _mm_slli_si128(_mm_loadu_si128(before + segmentLen - 1), 4);
+        __m128i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m128i left = _mm_loadu_si128(before + k);
+            __m128i cell = _mm_max_epi32(_mm_add_epi32(corner, _mm_loadu_si128(weights + k)),
+                                         _mm_add_epi32(left, gapV));
+            cell = _mm_max_epi32(cell, _mm_max_epi32(up, zero));
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epi32(best, cell);
+            up = _mm_add_epi32(cell, gapV);
+            corner = left;
+        }
+        up = _mm_slli_si128(up, 4);
+        for(int k = 0;
+            _mm_movemask_epi8(_mm_cmpgt_epi32(up, _mm_loadu_si128(filled + k))) != 0;)
         {
-            if(compareSequences(sequences[i], sequences[j], match, misMatch, gap, &score) < 0)
+            __m128i cell = _mm_max_epi32(_mm_loadu_si128(filled + k), up);
+            _mm_storeu_si128(filled + k, cell);
+            best = _mm_max_epi32(best, cell);
+            up = _mm_add_epi32(up, gapV);
+            if(++k == segmentLen)
             {
-                return;
+                k = 0;
+                up = _mm_slli_si128(up, 4);
             }
-            printf(SCORE_MSG, i + 1, j + 1, score);
         }
+        __m128i *swap = before;
+        before = filled;
+        filled = swap;
     }
+    best = _mm_max_epi32(best, _mm_srli_si128(best, 8));
+    best = _mm_max_epi32(best, _mm_srli_si128(best, 4));
+    *score = _mm_cvtsi128_si32(best);
+    return 0;
 }
 
 
-int compareSequences(const char *seq1, const char *seq2,
-                     const int *match, const int *misMatch, const int *gap, int *score)
+__attribute__((target("avx2")))
+int localAvx2(const char *seq1, int len1, const char *seq2, int len2,
+              const int *match, const int *misMatch, const int *gap,
+              DpWorkspace *workspace, int *score)
 {
-    int seqLen1 = (int)strlen(seq1);
-    int seqLen2 = (int)strlen(seq2);
-    int rowLen = seqLen1 + 1;
-    int colLen = seqLen2 + 1;
-    int *table = (int*)malloc(rowLen * colLen * sizeof(int));
-    if(table == NULL)
+    if(*gap > 0)
+    {
+        return localScalar(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    int retVal = LANES_OVERFLOW;
+    if(lanesFit(match, misMatch, gap, UCHAR_MAX))
+    {
+        retVal = stripedAvx2x8(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    if(retVal == LANES_OVERFLOW && lanesFit(match, misMatch, gap, USHRT_MAX))
+    {
+        retVal = stripedAvx2x16(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    if(retVal == LANES_OVERFLOW)
+    {
+        retVal = stripedAvx2x32(seq1, len1, seq2, len2, match, misMatch, gap, workspace, score);
+    }
+    return retVal;
+}
+
+
+__attribute__((target("avx2")))
+__m256i shiftAvx2x8(__m256i v)
+{
+    // the low half of v moved to the high half, under which alignr shifts.
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 15);
+}
+
+
+__attribute__((target("avx2")))
+__m256i shiftAvx2x16(__m256i v)
+{
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 14);
+}
+
+
+__attribute__((target("avx2")))
+__m256i shiftAvx2x32(__m256i v)
+{
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 12);
+}
+
+
+__attribute__((target("avx2")))
+int stripedAvx2x8(const char *seq1, int len1, const char *seq2, int len2,
+                  const int *match, const int *misMatch, const int *gap,
+                  DpWorkspace *workspace, int *score)
+{
+    int bias = (int)weightBias(match, misMatch);
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m256i), sizeof(unsigned char), bias,
+                      match, misMatch, workspace, &profile) < 0)
     {
-        fprintf(stderr, MEM_FAULT);
         return -1;
     }
-    // table initialization: first row and column are set.
-    for(int i = 0; i <= seqLen1; i++)
+    int segmentLen = profile.segmentLen;
+    __m256i *before = (__m256i*)profile.columns[0];
+    __m256i *filled = (__m256i*)profile.columns[1];
+    __m256i zero = _mm256_setzero_si256();
+    __m256i biasV = _mm256_set1_epi8((char)bias);
+    __m256i gapV = _mm256_set1_epi8((char)-*gap);
+    __m256i limitV = _mm256_set1_epi8((char)(UCHAR_MAX - bias));
+    __m256i best = zero;
+    for(int j = 0; j < len2; j++)
     {
-        table[i] = (*gap) * i;
+        const __m256i *weights = (const __m256i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        __m256i corner = shiftAvx2x8(_mm256_loadu_si256(before + segmentLen - 1));
+        __m256i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m256i left = _mm256_loadu_si256(before + k);
+            __m256i cell = _mm256_subs_epu8(
+                _mm256_adds_epu8(corner, _mm256_loadu_si256(weights + k)), biasV);
+            cell = _mm256_max_epu8(cell, _mm256_max_epu8(_mm256_subs_epu8(left, gapV), up));
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epu8(best, cell);
+            up = _mm256_subs_epu8(cell, gapV);
+            corner = left;
+        }
+        up = shiftAvx2x8(up);
+        for(int k = 0; _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                           _mm256_subs_epu8(up, _mm256_loadu_si256(filled + k)), zero)) != -1;)
+        {
+            __m256i cell = _mm256_max_epu8(_mm256_loadu_si256(filled + k), up);
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epu8(best, cell);
+            up = _mm256_subs_epu8(up, gapV);
+            if(++k == segmentLen)
+            {
+                k = 0;
+                up = shiftAvx2x8(up);
+            }
+        }
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(best, limitV), best)) != 0)
+        {
+            return LANES_OVERFLOW;
+        }
+        __m256i *swap = before;
+        before = filled;
+        filled = swap;
     }
-    for(int i = 1; i <= seqLen2; i++)
+    __m128i half = _mm_max_epu8(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 8));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 4));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 2));
+    half = _mm_max_epu8(half, _mm_srli_si128(half, 1));
+    *score = _mm_extract_epi8(half, 0);
+    return 0;
+}
+
+
+__attribute__((target("avx2")))
+int stripedAvx2x16(const char *seq1, int len1, const char *seq2, int len2,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace, int *score)
+{
+    int bias = (int)weightBias(match, misMatch);
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m256i), sizeof(unsigned short), bias,
+                      match, misMatch, workspace, &profile) < 0)
     {
-        table[i * rowLen] = (*gap) * i;
+        return -1;
     }
-    // main loop to fill the table. filling by columns.
-    for(int j = 1; j <= seqLen1; j++)
+    int segmentLen = profile.segmentLen;
+    __m256i *before = (__m256i*)profile.columns[0];
+    __m256i *filled = (__m256i*)profile.columns[1];
+    __m256i zero = _mm256_setzero_si256();
+    __m256i biasV = _mm256_set1_epi16((short)bias);
+    __m256i gapV = _mm256_set1_epi16((short)-*gap);
+    __m256i limitV = _mm256_set1_epi16((short)(USHRT_MAX - bias));
+    __m256i best = zero;
+    for(int j = 0; j < len2; j++)
     {
-        for(int i = 1; i <= seqLen2; i++)
+        const __m256i *weights = (const __m256i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        __m256i corner = shiftAvx2x16(_mm256_loadu_si256(before + segmentLen - 1));
+        __m256i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m256i left = _mm256_loadu_si256(before + k);
+            __m256i cell = _mm256_subs_epu16(
+                _mm256_adds_epu16(corner, _mm256_loadu_si256(weights + k)), biasV);
+            cell = _mm256_max_epu16(cell, _mm256_max_epu16(_mm256_subs_epu16(left, gapV), up));
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epu16(best, cell);
+            up = _mm256_subs_epu16(cell, gapV);
+            corner = left;
+        }
+        up = shiftAvx2x16(up);
+        for(int k = 0; _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                           _mm256_subs_epu16(up, _mm256_loadu_si256(filled + k)), zero)) != -1;)
         {
-            int up = table[((i - 1) * rowLen) + j] + (*gap);
-            int left = table[(i * rowLen) + j - 1] + (*gap);
-            if(seq1[j - 1] == seq2[i - 1])
+            __m256i cell = _mm256_max_epu16(_mm256_loadu_si256(filled + k), up);
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epu16(best, cell);
+            up = _mm256_subs_epu16(up, gapV);
+            if(++k == segmentLen)
             {
-                int corner = table[((i - 1) * rowLen) + j - 1] + (*match);
-                table[(i * rowLen) + j] = *myMax(&corner, myMax(&up, &left));
+                k = 0;
+                up = shiftAvx2x16(up);
             }
-            else
+        }
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_max_epu16(best, limitV), best)) != 0)
+        {
+            return LANES_OVERFLOW;
+        }
+        __m256i *swap = before;
+        before = filled;
+        filled = swap;
+    }
+    __m128i half = _mm_max_epu16(_mm256_castsi256_si128(best),
+                                 _mm256_extracti128_si256(best, 1));
+    half = _mm_max_epu16(half, _mm_srli_si128(half, 8));
+    half = _mm_max_epu16(half, _mm_srli_si128(half, 4));
+    half = _mm_max_epu16(half, _mm_srli_si128(half, 2));
+    *score = _mm_extract_epi16(half, 0);
+    return 0;
+}
+
+
+__attribute__((target("avx2")))
+int stripedAvx2x32(const char *seq1, int len1, const char *seq2, int len2,
+                   const int *match, const int *misMatch, const int *gap,
+                   DpWorkspace *workspace, int *score)
+{
+    StripedProfile profile;
+    if(prepareStriped(seq1, len1, seq2, len2, sizeof(__m256i), sizeof(int), 0, match, misMatch,
+                      workspace, &profile) < 0)
+    {
+        return -1;
+    }
+    int segmentLen = profile.segmentLen;
+    __m256i *before = (__m256i*)profile.columns[0];
+    __m256i *filled = (__m256i*)profile.columns[1];
+    __m256i zero = _mm256_setzero_si256();
+    __m256i gapV = _mm256_set1_epi32(*gap);
+    __m256i best = zero;
+    for(int j = 0; j < len2; j++)
+    {
+        const __m256i *weights = (const __m256i*)profile.weights +
+                                 (size_t)profile.codes[(unsigned char)seq2[j]] * segmentLen;
+        __m256i corner = shiftAvx2x32(_mm256_loadu_si256(before + segmentLen - 1));
+        __m256i up = zero;
+        for(int k = 0; k < segmentLen; k++)
+        {
+            __m256i left = _mm256_loadu_si256(before + k);
+            __m256i cell = _mm256_max_epi32(
+                _mm256_add_epi32(corner, _mm256_loadu_si256(weights + k)),
+                _mm256_add_epi32(left, gapV));
+            cell = _mm256_max_epi32(cell, _mm256_max_epi32(up, zero));
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epi32(best, cell);
+            up = _mm256_add_epi32(cell, gapV);
+            corner = left;
+        }
+        up = shiftAvx2x32(up);
+        for(int k = 0;
+            _mm256_movemask_epi8(_mm256_cmpgt_epi32(up, _mm256_loadu_si256(filled + k))) != 0;)
+        {
+            __m256i cell = _mm256_max_epi32(_mm256_loadu_si256(filled + k), up);
+            _mm256_storeu_si256(filled + k, cell);
+            best = _mm256_max_epi32(best, cell);
+            up = _mm256_add_epi32(up, gapV);
+            if(++k == segmentLen)
             {
-                int corner = table[(i - 1) * rowLen + j - 1] + (*misMatch);
-                table[(i * rowLen) + j] = *myMax(&corner, myMax(&up, &left));
+                k = 0;
+                up = shiftAvx2x32(up);
             }
         }
+        __m256i *swap = before;
+        before = filled;
+        filled = swap;
     }
-    *score = table[(rowLen * colLen) - 1];
-    free(table);
+    __m128i half = _mm_max_epi32(_mm256_castsi256_si128(best),
+                                 _mm256_extracti128_si256(best, 1));
+    half = _mm_max_epi32(half, _mm_srli_si128(half, 8));
+    half = _mm_max_epi32(half, _mm_srli_si128(half, 4));
+    *score = _mm_cvtsi128_si32(half);
     return 0;
 }
+#endif
 
 
 const int *myMax(const int *x, const int *y)
@@ -257,17 +3581,11 @@ const int *myMax(const int *x, const int *y)
 }
 
 
-void cleanUp(char **sequences)
+void cleanUp(SequenceSet *sequences)
 {
-    for (int i = 0; i < MAX_SEQUENCES; i++)
-    {
-        if (sequences[i] != NULL)
-        {
-            free(sequences[i]);
-            continue;
-        }
-        break;
-    }
+    free(sequences->arena);
+    free(sequences->offsets);
+    free(sequences->lens);
 }
 
 